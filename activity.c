@@ -0,0 +1,163 @@
+/* Per band activity time series, see activity.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include "activity.h"
+#include "batch.h"
+
+#define ACTIVITY_MAGIC 0x52424e41 // "RBNA"
+#define ACTIVITY_VERSION 1
+
+struct activity_file {
+  uint32_t magic;
+  uint32_t version;
+  int32_t base[BANDS];                  // Base frequency each row belongs to
+  uint32_t slot[ACTIVITY_SLOTS];        // Slot start of each ring position, 0 if empty
+  struct activity_bucket bucket[ACTIVITY_SLOTS][BANDS];
+};
+
+int activity_open(struct activity *a, const char *path, const struct config *c) {
+  struct activity_file *f;
+  int32_t fd;
+
+  a->file = NULL;
+
+  if((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+    fprintf(stderr, "Cannot open activity file %s.\n", path);
+    return -1;
+  }
+
+  // One writer per file for as long as it is mapped, a second uploader
+  // refuses to start instead of waiting for a daemon that never exits
+  if(flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    fprintf(stderr, "Activity file %s is in use by another uploader.\n", path);
+    close(fd);
+    return -1;
+  }
+
+  if(ftruncate(fd, sizeof(*f)) < 0) {
+    fprintf(stderr, "Cannot open activity file %s.\n", path);
+    close(fd);
+    return -1;
+  }
+
+  f = mmap(NULL, sizeof(*f), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // The lock stays with the mapping's open file description
+  if(f == MAP_FAILED) {
+    fprintf(stderr, "Cannot map activity file %s.\n", path);
+    return -1;
+  }
+
+  if(f->magic != ACTIVITY_MAGIC || f->version != ACTIVITY_VERSION) {
+    memset(f, 0, sizeof(*f));
+    f->magic = ACTIVITY_MAGIC;
+    f->version = ACTIVITY_VERSION;
+  }
+
+  a->file = f;
+  activity_rebind(a, c);
+  return 0;
+}
+
+// Rows of bands whose base frequency changed start over
+void activity_rebind(struct activity *a, const struct config *c) {
+  struct activity_file *f = a->file;
+  int32_t b, i, base;
+
+  for(b = 0; b < BANDS; b++) {
+    base = b < c->bands ? c->base[b] : 0;
+    if(f->base[b] == base) continue;
+    f->base[b] = base;
+    for(i = 0; i < ACTIVITY_SLOTS; i++) memset(&f->bucket[i][b], 0, sizeof(f->bucket[i][b]));
+  }
+}
+
+void activity_close(struct activity *a) {
+  if(a->file == NULL) return;
+  msync(a->file, sizeof(*a->file), MS_ASYNC);
+  munmap(a->file, sizeof(*a->file));
+  a->file = NULL;
+}
+
+size_t activity_memory(const struct activity *a) {
+  return a->file != NULL ? sizeof(*a->file) : 0;
+}
+
+void activity_add(struct activity *a, uint32_t band, uint32_t slot, uint32_t call_hash, int32_t snr) {
+  struct activity_file *f = a->file;
+  uint32_t i = slot / SLOT_SECONDS % ACTIVITY_SLOTS;
+  struct activity_bucket *bucket;
+
+  if(f->slot[i] != slot) {
+    if(f->slot[i] > slot) return; // Older than the ring reaches
+    memset(f->bucket[i], 0, sizeof(f->bucket[i]));
+    f->slot[i] = slot;
+  }
+
+  bucket = &f->bucket[i][band];
+  if(bucket->spots < UINT16_MAX) bucket->spots++;
+  bucket->snr_sum += snr;
+  call_hash %= ACTIVITY_BITS;
+  bucket->calls[call_hash / 8] |= 1 << (call_hash % 8);
+}
+
+// Linear counting estimate of distinct calls from the bitmap
+static double distinct(const struct activity_bucket *bucket) {
+  int32_t i, zero = 0;
+
+  for(i = 0; i < ACTIVITY_BITS; i++) zero += !(bucket->calls[i / 8] & (1 << (i % 8)));
+  if(zero == 0) zero = 1;
+  return ACTIVITY_BITS * log((double)ACTIVITY_BITS / zero);
+}
+
+int activity_dump_csv(const struct activity *a, const char *path) {
+  const struct activity_file *f = a->file;
+  const struct activity_bucket *bucket;
+  uint32_t i, n, b, last = 0, next;
+  char tmp[256], stamp[24];
+  struct tm tm;
+  time_t t;
+  FILE *fp;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if((fp = fopen(tmp, "w")) == NULL) {
+    fprintf(stderr, "Cannot write activity dump %s.\n", tmp);
+    return -1;
+  }
+
+  fprintf(fp, "slot,band,spots,calls,mean_snr\n");
+
+  // Ring positions in time order, selection is fine for a few hundred slots
+  for(n = 0; n < ACTIVITY_SLOTS; n++) {
+    next = 0;
+    for(i = 0; i < ACTIVITY_SLOTS; i++)
+      if(f->slot[i] > last && (next == 0 || f->slot[i] < f->slot[next - 1])) next = i + 1;
+    if(next == 0) break;
+    i = next - 1;
+    last = f->slot[i];
+
+    t = last;
+    gmtime_r(&t, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    for(b = 0; b < BANDS; b++) {
+      bucket = &f->bucket[i][b];
+      if(!bucket->spots) continue;
+      fprintf(fp, "%s,%d,%u,%.0f,%.1f\n", stamp, f->base[b], bucket->spots,
+        distinct(bucket), (double)bucket->snr_sum / bucket->spots);
+    }
+  }
+
+  if(fclose(fp) != 0 || rename(tmp, path) != 0) {
+    fprintf(stderr, "Cannot write activity dump %s.\n", path);
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+/* Per band activity time series.
+   A ring of slot buckets per band counts spots, distinct calls and
+   summed SNR as spots are sent. The ring lives in a memory mapped state
+   file, so it keeps its history across runs and never grows.
+   */
+
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "config.h"
+
+#define ACTIVITY_SLOTS 240 // One hour of FT8 slots
+#define ACTIVITY_BITS 256  // Bitmap size for distinct call estimation
+
+struct activity_bucket {
+  uint16_t spots;
+  uint16_t pad;
+  int32_t snr_sum;
+  uint8_t calls[ACTIVITY_BITS / 8]; // Bit per call hash, linear counting
+};
+
+struct activity_file;
+
+struct activity {
+  struct activity_file *file;
+};
+
+int activity_open(struct activity *a, const char *path, const struct config *c);
+void activity_rebind(struct activity *a, const struct config *c);
+void activity_close(struct activity *a);
+size_t activity_memory(const struct activity *a);
+void activity_add(struct activity *a, uint32_t band, uint32_t slot, uint32_t call_hash, int32_t snr);
+int activity_dump_csv(const struct activity *a, const char *path);
+
+#endif
@@ -0,0 +1,107 @@
+/* Startup sized memory, see alloc.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "metrics.h"
+
+// Bytes an arena needs for an allocation of size
+size_t arena_size(size_t size) {
+  return (size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+}
+
+int arena_init(struct arena *a, size_t size) {
+  a->size = arena_size(size);
+  a->used = 0;
+  if((a->base = aligned_alloc(ALLOC_ALIGN, a->size ? a->size : ALLOC_ALIGN)) == NULL) {
+    fprintf(stderr, "Cannot allocate %zu byte arena.\n", a->size);
+    return -1;
+  }
+  return 0;
+}
+
+void arena_free(struct arena *a) {
+  free(a->base);
+  a->base = NULL;
+  a->size = a->used = 0;
+}
+
+// Zeroed memory from the arena, NULL once it is used up
+void *arena_alloc(struct arena *a, size_t size) {
+  void *p;
+
+  size = arena_size(size);
+  if(a->size - a->used < size) return NULL;
+  p = a->base + a->used;
+  a->used += size;
+  memset(p, 0, size);
+  return p;
+}
+
+int pool_init(struct pool *p, struct arena *a, size_t item, uint32_t count) {
+  uint32_t i;
+
+  p->item = arena_size(item);
+  p->count = count;
+  p->base = arena_alloc(a, p->item * count);
+  p->next = arena_alloc(a, count * sizeof(*p->next));
+  if(p->base == NULL || p->next == NULL) return -1;
+
+  for(i = 0; i < count; i++) p->next[i] = i + 1 < count ? i + 2 : 0;
+  p->head = count ? 1 : 0;
+  p->used = 0;
+  return 0;
+}
+
+// Position of an item, stable for as long as it is in use
+uint32_t pool_index(const struct pool *p, const void *item) {
+  return ((const char *)item - p->base) / p->item;
+}
+
+void *pool_item(const struct pool *p, uint32_t index) {
+  return p->base + index * p->item;
+}
+
+// A free item, NULL if all are in use
+void *pool_get(struct pool *p) {
+  uint32_t i;
+
+  if(!p->head) return NULL;
+  i = p->head - 1;
+  p->head = p->next[i];
+  p->used++;
+  return p->base + i * p->item;
+}
+
+void pool_put(struct pool *p, void *item) {
+  uint32_t i = pool_index(p, item);
+
+  p->next[i] = p->head;
+  p->head = i + 1;
+  p->used--;
+}
+
+// Overridden by interpose.o in an ALLOC_COUNT program, the library
+// never replaces the allocator of the process it is linked into
+__attribute__((weak)) uint64_t alloc_count(void) {
+  return 0;
+}
+
+// Called once per slot, from one thread only
+void alloc_check(uint32_t slot) {
+#ifdef ALLOC_COUNT
+  static uint64_t last;
+  static uint32_t slots;
+  uint64_t now = alloc_count();
+
+  metrics_set("rbn_allocations_total", now);
+  if(slots >= ALLOC_WARMUP && now != last)
+    fprintf(stderr, "Warning: %llu allocations in slot %u after warm-up\n", (unsigned long long)(now - last), slot);
+  last = now;
+  slots++;
+#else
+  (void)slot;
+#endif
+}
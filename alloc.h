@@ -0,0 +1,51 @@
+/* Startup sized memory for the long running paths.
+   An arena is one allocation carved up by a bump pointer and released
+   as a whole, for structures that live as long as the process. A pool
+   hands out fixed size items from an arena through a free list, for
+   objects that come and go at run time. Neither touches malloc after
+   it is set up, so a resident uploader does not fragment the heap.
+   Built with -DALLOC_COUNT, interpose.c counts every malloc, calloc
+   and realloc in the program and alloc_check() warns about any made in
+   a slot once the first ALLOC_WARMUP slots are over. make check runs
+   decodes through an uploader that way and fails on any.
+   */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ALLOC_ALIGN 64        // Items start on their own cache line
+#define ALLOC_WARMUP 2        // Slots allowed to allocate while tables settle
+
+struct arena {
+  char *base;
+  size_t size;
+  size_t used;
+};
+
+struct pool {
+  char *base;
+  size_t item;                // Item size rounded up to ALLOC_ALIGN
+  uint32_t count;
+  uint32_t *next;             // Free list links, index + 1, 0 ends the list
+  uint32_t head;              // First free item + 1, 0 if exhausted
+  uint32_t used;
+};
+
+int arena_init(struct arena *a, size_t size);
+void arena_free(struct arena *a);
+void *arena_alloc(struct arena *a, size_t size);
+size_t arena_size(size_t size);
+
+int pool_init(struct pool *p, struct arena *a, size_t item, uint32_t count);
+void *pool_get(struct pool *p);
+void pool_put(struct pool *p, void *item);
+uint32_t pool_index(const struct pool *p, const void *item);
+void *pool_item(const struct pool *p, uint32_t index);
+
+uint64_t alloc_count(void);
+void alloc_check(uint32_t slot);
+
+#endif
@@ -0,0 +1,137 @@
+/* Structure-of-arrays spot batch, see batch.h */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+#define FIELDS(X) \
+  X(band) X(slot) X(time) X(freq) X(bfreq) X(snr) X(dt) X(sync) X(call) X(grid) X(flags) X(entity) \
+  X(order) X(key) X(tmp_key) X(tmp_order)
+
+static int resize(struct batch *b, uint32_t size) {
+  void *p;
+
+#define RESIZE(f) \
+  if((p = realloc(b->f, (size_t)size * sizeof(*b->f))) == NULL) return -1; \
+  b->f = p;
+  FIELDS(RESIZE)
+#undef RESIZE
+
+  b->size = size;
+  return 0;
+}
+
+int batch_init(struct batch *b, uint32_t size) {
+  memset(b, 0, sizeof(*b));
+  if(resize(b, size ? size : 256) < 0) {
+    batch_free(b);
+    return -1;
+  }
+  return 0;
+}
+
+void batch_free(struct batch *b) {
+#define FREE(f) free(b->f);
+  FIELDS(FREE)
+#undef FREE
+  memset(b, 0, sizeof(*b));
+}
+
+void batch_clear(struct batch *b) {
+  b->count = 0;
+}
+
+// Append an uninitialised spot and return its index, -1 if out of
+// memory or at the limit
+int32_t batch_add(struct batch *b) {
+  uint32_t size = b->limit && 2 * b->size > b->limit ? b->limit : 2 * b->size;
+
+  if(b->count == b->size && (size == b->size || resize(b, size) < 0)) return -1;
+  return b->count++;
+}
+
+// Bytes of every field of one spot
+size_t batch_spot_size(void) {
+  struct batch *b = NULL;
+  size_t size = 0;
+
+#define SIZE(f) size += sizeof(*b->f);
+  FIELDS(SIZE)
+#undef SIZE
+
+  return size;
+}
+
+size_t batch_memory(const struct batch *b) {
+  return b->size * batch_spot_size();
+}
+
+void batch_set_grid(struct batch *b, uint32_t i, const char *grid) {
+  uint32_t g = 0, n;
+
+  for(n = 0; n < 4 && grid[n]; n++) g |= (uint32_t)(uint8_t)grid[n] << (8 * n);
+  b->grid[i] = g;
+}
+
+void batch_get_grid(const struct batch *b, uint32_t i, char *grid) {
+  uint32_t n;
+
+  for(n = 0; n < 4; n++) grid[n] = b->grid[i] >> (8 * n);
+  grid[4] = 0;
+}
+
+/* Key layout: band in bits 59-63, slot number (slot / SLOT_SECONDS)
+   counted from the batch's oldest slot in bits 32-58, frequency in bits
+   0-31. 27 bits of slots span 63 years within one batch, whatever the
+   date. Sorting is stable, spots with equal keys stay in arrival order. */
+void batch_sort(struct batch *b) {
+  uint32_t i, oldest = UINT32_MAX;
+
+  for(i = 0; i < b->count; i++)
+    if(b->slot[i] / SLOT_SECONDS < oldest) oldest = b->slot[i] / SLOT_SECONDS;
+
+  for(i = 0; i < b->count; i++) {
+    b->key[i] = (uint64_t)b->band[i] << 59
+      | (uint64_t)((b->slot[i] / SLOT_SECONDS - oldest) & 0x7ffffff) << 32
+      | (uint32_t)b->freq[i];
+    b->order[i] = i;
+  }
+  batch_sort_keys(b, b->count);
+}
+
+// Stable LSD radix sort of the first n keys the caller put into
+// b->key, carrying b->order along
+void batch_sort_keys(struct batch *b, uint32_t n) {
+  uint32_t i, pass, count[256];
+  uint64_t *key = b->key, *tmp_key = b->tmp_key, *swap_key, diff = 0;
+  uint32_t *order = b->order, *tmp_order = b->tmp_order, *swap_order;
+
+  for(i = 0; i < n; i++) diff |= key[i] ^ key[0];
+
+  for(pass = 0; pass < 8; pass++) {
+    uint32_t shift = 8 * pass, sum = 0, c;
+
+    if(!((diff >> shift) & 0xff)) continue; // Digit is the same everywhere
+
+    memset(count, 0, sizeof(count));
+    for(i = 0; i < n; i++) count[(key[i] >> shift) & 0xff]++;
+    for(i = 0; i < 256; i++) {
+      c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for(i = 0; i < n; i++) {
+      c = count[(key[i] >> shift) & 0xff]++;
+      tmp_key[c] = key[i];
+      tmp_order[c] = order[i];
+    }
+
+    swap_key = key; key = tmp_key; tmp_key = swap_key;
+    swap_order = order; order = tmp_order; tmp_order = swap_order;
+  }
+
+  // Keep the result in b->order whichever buffer the last pass wrote
+  b->key = key; b->tmp_key = tmp_key;
+  b->order = order; b->tmp_order = tmp_order;
+}
@@ -0,0 +1,53 @@
+/* Structure-of-arrays batch of parsed spots.
+   Each field lives in its own array so that scans over one or two
+   fields (band, slot, call id) touch only the memory they need.
+   batch_sort() builds a permutation ordered by (band, slot, frequency)
+   with an LSD radix sort, the spots themselves are never moved;
+   batch_sort_keys() sorts by keys of the caller's choosing.
+   */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLOT_SECONDS 15 // FT8 slot length
+
+#define SPOT_FIRST 0x01 // Call never heard on this band before
+#define SPOT_SHED  0x02 // Left out of the send by load shedding
+
+struct batch {
+  uint32_t count;     // Spots in batch
+  uint32_t size;      // Allocated spots
+  uint32_t limit;     // Spots the batch may grow to, 0 for no limit
+  uint8_t *band;      // Band index, BAND_OTHER when off plan
+  uint32_t *slot;     // Slot start, seconds since the epoch
+  uint32_t *time;     // Decode timestamp, seconds since the epoch
+  int32_t *freq;      // Receive frequency in Hz
+  int32_t *bfreq;     // Snapped base frequency in Hz
+  int16_t *snr;       // SNR in dB
+  double *dt;         // Timing error in seconds, as sent
+  float *sync;        // Sync metric
+  uint32_t *call;     // Interned call id
+  uint32_t *grid;     // Up to four grid characters, first in lowest byte
+  uint8_t *flags;     // SPOT_ flags
+  uint16_t *entity;   // DXCC entity index, CTY_NONE if unknown
+  uint32_t *order;    // Sorted permutation after batch_sort()
+  uint64_t *key;      // Sort scratch
+  uint64_t *tmp_key;
+  uint32_t *tmp_order;
+};
+
+int batch_init(struct batch *b, uint32_t size);
+void batch_free(struct batch *b);
+void batch_clear(struct batch *b);
+int32_t batch_add(struct batch *b);
+void batch_set_grid(struct batch *b, uint32_t i, const char *grid);
+void batch_get_grid(const struct batch *b, uint32_t i, char *grid);
+void batch_sort(struct batch *b);
+void batch_sort_keys(struct batch *b, uint32_t n);
+size_t batch_memory(const struct batch *b);
+size_t batch_spot_size(void);
+
+#endif
@@ -0,0 +1,63 @@
+/* Memory budget, see budget.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "budget.h"
+#include "metrics.h"
+
+#define BUDGET_SLACK 8          // 1/8 of what is left stays free for malloc overhead and stacks
+#define BUDGET_MIN 65536        // Smallest useful share of the growing tables
+
+const char *budget_part[BUDGET_PARTS] = { "fixed", "spots", "first", "sketches" };
+
+// Split what fixed leaves of total among the growing parts by weight,
+// -1 if the budget cannot even hold the fixed part
+int budget_plan(struct budget *b, uint64_t total, uint64_t fixed, const uint32_t *weight) {
+  uint64_t left;
+  uint32_t i, sum = 0;
+
+  memset(b, 0, sizeof(*b));
+  b->total = total;
+  b->limit[BUDGET_FIXED] = fixed;
+
+  left = total > fixed ? (total - fixed) / BUDGET_SLACK * (BUDGET_SLACK - 1) : 0;
+  if(left < BUDGET_MIN) {
+    fprintf(stderr, "Cannot fit into a memory budget of %llu bytes, %llu are needed at startup.\n",
+      (unsigned long long)total, (unsigned long long)(fixed + BUDGET_MIN * BUDGET_SLACK / (BUDGET_SLACK - 1)));
+    return -1;
+  }
+
+  for(i = BUDGET_FIXED + 1; i < BUDGET_PARTS; i++) sum += weight[i];
+  for(i = BUDGET_FIXED + 1; i < BUDGET_PARTS; i++) b->limit[i] = sum ? left / sum * weight[i] : 0;
+  return 0;
+}
+
+// Resident set size from /proc, read without stdio so it never allocates
+uint64_t budget_rss(void) {
+  char text[128];
+  ssize_t n;
+  int fd;
+
+  if((fd = open("/proc/self/statm", O_RDONLY)) < 0) return 0;
+  n = read(fd, text, sizeof(text) - 1);
+  close(fd);
+  if(n <= 0) return 0;
+  text[n] = 0;
+
+  return strtoull(strchr(text, ' ') != NULL ? strchr(text, ' ') : text, NULL, 10) * sysconf(_SC_PAGESIZE);
+}
+
+void budget_report(const struct budget *b, int32_t part, uint64_t used) {
+  char series[96];
+
+  snprintf(series, sizeof(series), "rbn_memory_bytes{part=\"%s\"}", budget_part[part]);
+  metrics_set(series, used);
+  snprintf(series, sizeof(series), "rbn_memory_limit_bytes{part=\"%s\"}", budget_part[part]);
+  metrics_set(series, b->limit[part]);
+  snprintf(series, sizeof(series), "rbn_memory_evictions_total{part=\"%s\"}", budget_part[part]);
+  metrics_set(series, b->evictions[part]);
+}
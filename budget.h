@@ -0,0 +1,31 @@
+/* Memory budget for receiver boards with little RAM.
+   One cap for the whole process, shared out once at startup. What is
+   fixed by then (process image, send queue, rings, mapped state files,
+   duplicate table) is charged first, the rest is split among the
+   tables that grow with traffic. A table that reaches its share gives
+   something up instead of growing: the spot batch is sent early, new
+   calls are merged into the first heard file, the call count sketches
+   keep fewer days and evict the oldest.
+   */
+
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum { BUDGET_FIXED, BUDGET_SPOTS, BUDGET_FIRST, BUDGET_SKETCHES, BUDGET_PARTS };
+
+struct budget {
+  uint64_t total;                     // Cap in bytes, 0 for none
+  uint64_t limit[BUDGET_PARTS];       // Share of each part, the fixed part as charged
+  uint32_t evictions[BUDGET_PARTS];   // Times a part gave something up, owner thread only
+};
+
+extern const char *budget_part[BUDGET_PARTS];
+
+int budget_plan(struct budget *b, uint64_t total, uint64_t fixed, const uint32_t *weight);
+uint64_t budget_rss(void);
+void budget_report(const struct budget *b, int32_t part, uint64_t used);
+
+#endif
@@ -0,0 +1,380 @@
+/* Local DX cluster, see cluster.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "cluster.h"
+#include "metrics.h"
+
+enum { EV_LISTEN, EV_WAKE, EV_CLIENT };   // EV_CLIENT + client index
+
+struct cluster_item {
+  int32_t freq, snr;
+  uint32_t when;
+  char call[16];
+  char grid[8];
+};
+
+// One logging program, from the client pool
+struct cluster_client {
+  int fd;
+  int32_t logged_in;
+  int32_t armed;                      // EPOLLOUT requested
+  uint32_t since;                     // Last time output was taken or none was waiting
+  uint32_t in_used, out_head, out_used;
+  char call[16];
+  char in[128];
+  char out[CLUSTER_BUFFER];
+};
+
+static uint32_t seconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+size_t cluster_memory(void) {
+  return arena_size(CLUSTER_RING * sizeof(struct cluster_item))
+    + arena_size(CLUSTER_CLIENTS * arena_size(sizeof(struct cluster_client))) + arena_size(CLUSTER_CLIENTS * sizeof(uint32_t));
+}
+
+static void drop(struct cluster *c, struct cluster_client *k) {
+  epoll_ctl(c->epfd, EPOLL_CTL_DEL, k->fd, NULL);
+  close(k->fd);
+  k->fd = -1;
+  pool_put(&c->clients, k);
+  c->connected--;
+}
+
+// Write what the socket takes now, EPOLLOUT brings the rest
+static void flush(struct cluster *c, struct cluster_client *k) {
+  struct epoll_event ev;
+  ssize_t n = 0;
+
+  while(k->out_used && (n = send(k->fd, k->out + k->out_head, k->out_used, MSG_NOSIGNAL | MSG_DONTWAIT)) > 0) {
+    k->out_head += n;
+    k->out_used -= n;
+    k->since = seconds();
+  }
+  if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    drop(c, k);
+    return;
+  }
+  if(!k->out_used) k->out_head = 0;
+
+  if(!k->out_used != !k->armed) {
+    k->armed = k->out_used > 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (k->armed ? EPOLLOUT : 0);
+    ev.data.u32 = EV_CLIENT + pool_index(&c->clients, k);
+    epoll_ctl(c->epfd, EPOLL_CTL_MOD, k->fd, &ev);
+  }
+}
+
+// Append to the output buffer. When it is full the socket gets what it
+// takes first, a client whose socket is full as well is dropped.
+static int queue(struct cluster *c, struct cluster_client *k, const char *text, uint32_t size) {
+  if(k->out_used + size > CLUSTER_BUFFER) {
+    flush(c, k);
+    if(k->fd < 0) return -1;
+  }
+  if(k->out_head + k->out_used + size > CLUSTER_BUFFER) {
+    memmove(k->out, k->out + k->out_head, k->out_used);
+    k->out_head = 0;
+  }
+  if(k->out_used + size > CLUSTER_BUFFER) {
+    c->slow++;
+    drop(c, k);
+    return -1;
+  }
+
+  if(!k->out_used) k->since = seconds();
+  memcpy(k->out + k->out_head + k->out_used, text, size);
+  k->out_used += size;
+  return 0;
+}
+
+static int format(const struct cluster *c, const struct cluster_item *s, char *line, size_t size) {
+  char spotter[20], comment[32];
+
+  snprintf(spotter, sizeof(spotter), "%s:", c->spotter);
+  snprintf(comment, sizeof(comment), "%s %d dB %s", c->mode, s->snr, s->grid);
+  return snprintf(line, size, "DX de %-9s %8.1f  %-12s %-30s %02u%02uZ\r\n", spotter, s->freq / 1e3, s->call,
+    comment, s->when / 3600 % 24, s->when / 60 % 60);
+}
+
+// Every spot waiting in the ring to every client logged in, then one write each
+static void deliver(struct cluster *c) {
+  struct cluster_client *k;
+  struct cluster_item s;
+  char line[128];
+  uint32_t i, now;
+  int size;
+
+  while(ring_depth(&c->spots)) {
+    ring_pop(&c->spots, &s);
+    size = format(c, &s, line, sizeof(line));
+    for(i = 0; i < CLUSTER_CLIENTS; i++) {
+      k = pool_item(&c->clients, i);
+      if(k->fd >= 0 && k->logged_in) queue(c, k, line, size);
+    }
+    c->sent++;
+  }
+
+  now = seconds();
+  for(i = 0; i < CLUSTER_CLIENTS; i++) {
+    k = pool_item(&c->clients, i);
+    if(k->fd >= 0 && k->out_used && now - k->since > CLUSTER_STALL) {
+      c->slow++;
+      drop(c, k);
+    }
+    else if(k->fd >= 0 && k->out_used) flush(c, k);
+  }
+}
+
+// The first line is the client's call, later ones are commands
+static int command(struct cluster *c, struct cluster_client *k, const char *line) {
+  char text[160];
+  int i, n = 0;
+
+  if(k->logged_in) {
+    if(strcasecmp(line, "bye") == 0 || strcasecmp(line, "quit") == 0) return -1;
+    return 0; // Filters and the like are for real clusters
+  }
+
+  for(i = 0; line[i] && n < (int)sizeof(k->call) - 1; i++)
+    if(isalnum((unsigned char)line[i]) || line[i] == '/') k->call[n++] = toupper((unsigned char)line[i]);
+    else if(n) break;
+  k->call[n] = 0;
+
+  if(!n) n = snprintf(text, sizeof(text), "Please enter your call: ");
+  else {
+    k->logged_in = 1;
+    n = snprintf(text, sizeof(text), "Hello %s, this is %s, spots of this receiver only.\r\n%s de %s >\r\n",
+      k->call, c->spotter, k->call, c->spotter);
+  }
+  return queue(c, k, text, n);
+}
+
+// Split what arrived into lines, telnet negotiation and other control bytes are left out
+static void on_client(struct cluster *c, struct cluster_client *k, uint32_t events) {
+  char data[512], line[sizeof(k->in)];
+  ssize_t size, i;
+
+  if(k->fd < 0) return; // Dropped earlier in the same batch of events
+  if(events & EPOLLOUT) flush(c, k);
+  if(k->fd < 0 || !(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+
+  while((size = read(k->fd, data, sizeof(data))) > 0)
+    for(i = 0; i < size; i++) {
+      if(data[i] == '\n' || data[i] == '\r') {
+        if(!k->in_used && data[i] == '\n') continue; // Second half of CR LF
+        memcpy(line, k->in, k->in_used);
+        line[k->in_used] = 0;
+        k->in_used = 0;
+        if(command(c, k, line) < 0) {
+          if(k->fd >= 0) drop(c, k);
+          return;
+        }
+      }
+      else if(isprint((unsigned char)data[i]) && k->in_used < sizeof(k->in) - 1) k->in[k->in_used++] = data[i];
+    }
+
+  if(size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) drop(c, k);
+  else flush(c, k);
+}
+
+static void on_listen(struct cluster *c) {
+  static const char prompt[] = "Please enter your call: ";
+  struct epoll_event ev;
+  struct cluster_client *k;
+  int fd;
+
+  while((fd = accept4(c->listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    if((k = pool_get(&c->clients)) == NULL) {
+      close(fd); // Full, the program tries again later
+      continue;
+    }
+
+    k->fd = fd;
+    k->logged_in = k->armed = 0;
+    k->in_used = k->out_head = k->out_used = 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_CLIENT + pool_index(&c->clients, k);
+    if(epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      k->fd = -1;
+      pool_put(&c->clients, k);
+      continue;
+    }
+    c->connected++;
+    if(queue(c, k, prompt, sizeof(prompt) - 1) == 0) flush(c, k);
+  }
+}
+
+static void *serve(void *arg) {
+  struct cluster *c = arg;
+  struct epoll_event events[16];
+  uint64_t value;
+  int i, n;
+
+  while(!atomic_load(&c->stop)) {
+    if((n = epoll_wait(c->epfd, events, 16, -1)) < 0) continue;
+
+    for(i = 0; i < n; i++)
+      switch(events[i].data.u32) {
+        case EV_LISTEN: on_listen(c); break;
+        case EV_WAKE:
+          if(read(c->wake, &value, sizeof(value)) < 0) break;
+          deliver(c);
+          break;
+        default: on_client(c, pool_item(&c->clients, events[i].data.u32 - EV_CLIENT), events[i].events);
+      }
+  }
+
+  return NULL;
+}
+
+static int open_server(const char *spec) {
+  struct sockaddr_in addr;
+  char host[64];
+  const char *colon = strrchr(spec, ':');
+  int fd, on = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(atoi(colon != NULL ? colon + 1 : spec));
+  if(colon != NULL) {
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+    addr.sin_addr.s_addr = inet_addr(host);
+  }
+
+  if((fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)) < 0
+      || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+      || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+    fprintf(stderr, "Cannot listen on %s.\n", spec);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int watch_fd(struct cluster *c, int fd, uint32_t tag) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  return epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// spec is [address:]port. Ring and clients come from a, which needs
+// cluster_memory() bytes.
+int cluster_open(struct cluster *c, struct arena *a, const char *spec, const char *call, const char *mode) {
+  sigset_t all, old;
+  uint32_t i;
+
+  memset(c, 0, sizeof(*c));
+  c->epfd = c->listen = c->wake = -1;
+  snprintf(c->spotter, sizeof(c->spotter), "%.13s-#", call);
+  snprintf(c->mode, sizeof(c->mode), "%s", mode);
+
+  if(ring_init(&c->spots, a, CLUSTER_RING, sizeof(struct cluster_item)) < 0
+      || pool_init(&c->clients, a, sizeof(struct cluster_client), CLUSTER_CLIENTS) < 0) {
+    fprintf(stderr, "Cannot allocate DX cluster clients.\n");
+    return -1;
+  }
+  for(i = 0; i < CLUSTER_CLIENTS; i++) ((struct cluster_client *)pool_item(&c->clients, i))->fd = -1;
+
+  if((c->listen = open_server(spec)) < 0) return -1;
+
+  if((c->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (c->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+      || watch_fd(c, c->listen, EV_LISTEN) < 0 || watch_fd(c, c->wake, EV_WAKE) < 0) {
+    fprintf(stderr, "Cannot set up DX cluster.\n");
+    goto fail;
+  }
+
+  // The server never takes signals, the daemon loop handles them
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  if(pthread_create(&c->thread, NULL, serve, c) != 0) {
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    fprintf(stderr, "Cannot start DX cluster thread.\n");
+    goto fail;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  return 0;
+
+  // No thread yet, cluster_close() would wait for it
+fail:
+  if(c->epfd >= 0) close(c->epfd);
+  if(c->wake >= 0) close(c->wake);
+  close(c->listen);
+  c->epfd = c->listen = c->wake = -1;
+  return -1;
+}
+
+// Deliver what is left, then disconnect everyone
+void cluster_close(struct cluster *c) {
+  struct cluster_client *k;
+  uint64_t one = 1;
+  uint32_t i;
+
+  if(c->wake < 0) return;
+  atomic_store(&c->stop, 1);
+  if(write(c->wake, &one, sizeof(one)) < 0) fprintf(stderr, "Cannot stop DX cluster thread.\n");
+  pthread_join(c->thread, NULL);
+
+  for(i = 0; i < CLUSTER_CLIENTS; i++) {
+    k = pool_item(&c->clients, i);
+    if(k->fd >= 0) drop(c, k);
+  }
+  close(c->listen);
+  close(c->wake);
+  close(c->epfd);
+  c->wake = -1;
+}
+
+// Called from the one thread that sends, a full ring only costs the cluster this spot
+void cluster_spot(struct cluster *c, const char *call, const char *grid, int32_t freq, int32_t snr, uint32_t when) {
+  struct cluster_item s;
+
+  s.freq = freq;
+  s.snr = snr;
+  s.when = when;
+  snprintf(s.call, sizeof(s.call), "%s", call);
+  snprintf(s.grid, sizeof(s.grid), "%s", grid);
+  if(ring_try_push(&c->spots, &s) < 0) c->dropped++;
+  else c->pushed++;
+}
+
+// Wake the server once for everything pushed since the last call
+void cluster_wake(struct cluster *c) {
+  uint64_t one = 1;
+
+  if(!c->pushed) return;
+  c->pushed = 0;
+  if(write(c->wake, &one, sizeof(one)) < 0) return; // Counter at its limit, the server is awake anyway
+}
+
+void cluster_report(struct cluster *c) {
+  metrics_set("rbn_cluster_clients", c->connected);
+  metrics_set("rbn_cluster_spots_total", c->sent);
+  metrics_set("rbn_cluster_dropped_total", c->dropped);
+  metrics_set("rbn_cluster_slow_total", c->slow);
+}
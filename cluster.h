@@ -0,0 +1,49 @@
+/* Local DX cluster.
+   A telnet server that gives logging programs the spots of this
+   receiver as "DX de" lines the moment they are broadcast, without
+   the round trip through RBN. Spots are handed over a lock-free ring
+   to a thread of its own that runs the server; a full ring drops the
+   spot for the cluster, never the upload. Each client logs in with
+   its call and gets an output buffer of CLUSTER_BUFFER bytes that is
+   written without blocking after each batch, or sooner when it fills.
+   A client whose socket and buffer are both full, or that takes no
+   output for CLUSTER_STALL seconds, is disconnected, so a stuck
+   client costs nothing but its slot.
+   */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "ring.h"
+
+#define CLUSTER_CLIENTS 64        // Clients connected at once
+#define CLUSTER_BUFFER 16384      // Output waiting per client, about 200 spots
+#define CLUSTER_STALL 60          // Seconds a client may leave output waiting
+#define CLUSTER_RING 4096         // Spots waiting for the server thread, a power of two
+
+struct cluster {
+  struct ring spots;              // Uploader to server thread
+  struct pool clients;
+  pthread_t thread;
+  int epfd, listen, wake;         // wake is an eventfd the uploader writes once per batch
+  int32_t pushed;                 // Spots pushed since the last wake
+  _Atomic int32_t stop;
+  char spotter[16];               // Receiver call with -#, as skimmers sign their spots
+  char mode[8];
+  _Atomic uint32_t connected, sent, dropped, slow;
+};
+
+size_t cluster_memory(void);
+int cluster_open(struct cluster *c, struct arena *a, const char *spec, const char *call, const char *mode);
+void cluster_close(struct cluster *c);
+void cluster_spot(struct cluster *c, const char *call, const char *grid, int32_t freq, int32_t snr, uint32_t when);
+void cluster_wake(struct cluster *c);
+void cluster_report(struct cluster *c);
+
+#endif
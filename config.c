@@ -0,0 +1,175 @@
+/* Run time configuration, see config.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+
+// Standard base frequencies of the receiver channels
+static const int32_t default_base[] = {
+   1840000,  3573000,  5357000,  7056000,  7074000, 10131000, 10136000, 14074000,
+  18095000, 18100000, 21074000, 24911000, 24915000, 28074000, 50313000, 50323000
+};
+
+static const struct filter pass_all = { -HUGE_VAL, -1000, HUGE_VAL };
+
+void config_default(struct config *c) {
+  int32_t i;
+
+  memset(c, 0, sizeof(*c));
+  c->bands = sizeof(default_base) / sizeof(default_base[0]);
+  for(i = 0; i < c->bands; i++) c->base[i] = default_base[i];
+  for(i = 0; i < BANDS; i++) c->filter[i] = pass_all;
+  c->clock_warn = 0.5;
+  c->spots = 256;
+  c->calls = 1024;
+}
+
+// Parse "sync X", "snr N" and "dt X" pairs into filter
+static int parse_filter(char *args, struct filter *f) {
+  char *key, *value, *end;
+
+  if(args == NULL) return 0;
+
+  while((key = strtok(args, " \t\r\n")) != NULL) {
+    args = NULL;
+    if((value = strtok(NULL, " \t\r\n")) == NULL) return -1;
+    if(strcmp(key, "sync") == 0) f->min_sync = strtod(value, &end);
+    else if(strcmp(key, "snr") == 0) f->min_snr = strtol(value, &end, 10);
+    else if(strcmp(key, "dt") == 0) f->max_dt = fabs(strtod(value, &end));
+    else return -1;
+    if(*end) return -1;
+  }
+
+  return 0;
+}
+
+/* Config file format, one statement per line, # starts a comment:
+     band <base Hz>                        - the first band line replaces the built-in plan
+     filter <base Hz|all|other> [sync X] [snr N] [dt X]
+     clock_warn <seconds>                  - 0 disables the receiver clock warning
+     spots <n>                             - spots per batch to allocate at startup
+     calls <n>                             - calls to size the call tables for
+     memory <bytes>[k|M|G]                 - memory budget of the whole process
+     backlog <seconds>                     - send backlog beyond which spots are shed
+     max_age <seconds>                     - spots older than this at send are not broadcast
+     receiver <call> <locator>             - receiver as reported to PSK Reporter and DX cluster clients
+     antenna <text>                        - antenna as reported to PSK Reporter
+   A decode is rejected when sync < X, snr < N or |dt| > X. "filter all"
+   applies to every band known so far, to off plan frequencies and to
+   bands added later. */
+int config_load(struct config *c, const char *path) {
+  FILE *fp;
+  char line[256], *key, *arg, *rest, *unit = NULL, *locator;
+  const char *units = "kMG";
+  int32_t i, n = 0, plan = 0, base;
+  struct filter f, all = pass_all;
+
+  if((fp = fopen(path, "r")) == NULL) {
+    fprintf(stderr, "Cannot open config file %s.\n", path);
+    return -1;
+  }
+
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    n++;
+    if((rest = strchr(line, '#')) != NULL) *rest = 0;
+    if((key = strtok(line, " \t\r\n")) == NULL) continue;
+    arg = strtok(NULL, " \t\r\n");
+    rest = arg ? strtok(NULL, "") : NULL;
+
+    if(strcmp(key, "band") == 0 && arg && !rest) {
+      if(!plan) c->bands = 0; // Replace built-in plan
+      plan = 1;
+      base = atoi(arg);
+      if(base <= 0 || c->bands == BAND_OTHER) goto fail;
+      c->base[c->bands] = base;
+      c->filter[c->bands++] = all;
+    }
+    else if(strcmp(key, "clock_warn") == 0 && arg && !rest) {
+      c->clock_warn = fabs(strtod(arg, &rest));
+      if(*rest) goto fail;
+    }
+    else if(strcmp(key, "receiver") == 0 && arg && rest) {
+      locator = strtok(rest, " \t\r\n");
+      if(locator == NULL || strtok(NULL, " \t\r\n") != NULL
+          || strlen(arg) >= sizeof(c->receiver) || strlen(locator) >= sizeof(c->locator)) goto fail;
+      strcpy(c->receiver, arg);
+      strcpy(c->locator, locator);
+    }
+    else if(strcmp(key, "antenna") == 0 && arg) {
+      snprintf(c->antenna, sizeof(c->antenna), "%s %s", arg, rest ? rest : "");
+      for(i = strlen(c->antenna); i > 0 && strchr(" \t\r\n", c->antenna[i - 1]); i--) c->antenna[i - 1] = 0;
+    }
+    else if(strcmp(key, "max_age") == 0 && arg && !rest) {
+      i = strtol(arg, &rest, 10);
+      if(*rest || i <= 0) goto fail;
+      c->max_age = i;
+    }
+    else if(strcmp(key, "backlog") == 0 && arg && !rest) {
+      c->backlog = strtod(arg, &rest);
+      if(*rest || !(c->backlog > 0)) goto fail;
+    }
+    else if((strcmp(key, "spots") == 0 || strcmp(key, "calls") == 0) && arg && !rest) {
+      i = strtol(arg, &rest, 10);
+      if(*rest || i <= 0) goto fail;
+      if(key[0] == 's') c->spots = i;
+      else c->calls = i;
+    }
+    else if(strcmp(key, "memory") == 0 && arg && !rest) {
+      c->memory = strtoull(arg, &rest, 10);
+      if(*rest && (rest[1] || (unit = strchr(units, *rest)) == NULL)) goto fail;
+      if(*rest) c->memory <<= 10 * (unit - units + 1);
+      if(!c->memory) goto fail;
+    }
+    else if(strcmp(key, "filter") == 0 && arg) {
+      if(strcmp(arg, "all") == 0) {
+        if(parse_filter(rest, &all) < 0) goto fail;
+        for(i = 0; i < c->bands; i++) c->filter[i] = all;
+        c->filter[BAND_OTHER] = all;
+        continue;
+      }
+      if(strcmp(arg, "other") == 0) i = BAND_OTHER;
+      else {
+        base = atoi(arg);
+        for(i = 0; i < c->bands && c->base[i] != base; i++);
+        if(i == c->bands) goto fail;
+      }
+      f = c->filter[i];
+      if(parse_filter(rest, &f) < 0) goto fail;
+      c->filter[i] = f;
+    }
+    else goto fail;
+  }
+
+  fclose(fp);
+  return 0;
+
+fail:
+  fprintf(stderr, "Syntax error in %s line %d.\n", path, n);
+  fclose(fp);
+  return -1;
+}
+
+// Snap frequency to a standard base frequency, round down if outside plan
+int32_t config_snap(const struct config *c, int32_t freq, int32_t *bfreq) {
+  int32_t i, khz = freq / 1000;
+
+  for(i = 0; i < c->bands; i++) {
+    if(khz >= c->base[i] / 1000 && khz <= c->base[i] / 1000 + 3) {
+      *bfreq = c->base[i];
+      return i;
+    }
+  }
+
+  *bfreq = 1000 * (int)((freq - 200) / 1000);
+  return BAND_OTHER;
+}
+
+int32_t filter_check(const struct filter *f, double sync, int32_t snr, double dt) {
+  if(sync < f->min_sync) return FILTER_SYNC;
+  if(snr < f->min_snr) return FILTER_SNR;
+  if(fabs(dt) > f->max_dt) return FILTER_DT;
+  return FILTER_PASS;
+}
@@ -0,0 +1,49 @@
+/* Run time configuration: band plan and per band quality filters.
+   Loaded from an optional text file, see config_load() for the format.
+   */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#define BANDS 32                 // Band plan entries including BAND_OTHER
+#define BAND_OTHER (BANDS - 1)   // Index used for frequencies outside the plan
+
+#define FILTER_PASS 0            // filter_check() results
+#define FILTER_SYNC 1
+#define FILTER_SNR  2
+#define FILTER_DT   3
+
+struct filter {
+  double min_sync;               // Reject decodes with lower sync
+  int32_t min_snr;               // Reject decodes with lower SNR
+  double max_dt;                 // Reject decodes with larger |dt|
+};
+
+struct filter_stats {
+  uint32_t passed;
+  uint32_t rejected[4];          // Indexed by FILTER_SYNC, FILTER_SNR, FILTER_DT
+};
+
+struct config {
+  int32_t bands;                 // Number of bands in plan
+  int32_t base[BANDS];           // Base frequency of each band in Hz
+  struct filter filter[BANDS];   // Filter per band, BAND_OTHER for off plan
+  double clock_warn;             // Warn when median dt of a slot exceeds this
+  uint32_t spots;                // Spots per batch allocated at startup
+  uint32_t calls;                // Calls in the interning table and new call set
+  uint64_t memory;               // Memory budget in bytes, 0 for none
+  double backlog;                // Send backlog in seconds that starts load shedding, 0 for none
+  uint32_t max_age;              // Seconds after its decode a spot is still broadcast, 0 for ever
+  char receiver[16];             // Receiver call sign and locator for PSK Reporter
+  char locator[8];
+  char antenna[64];              // Antenna description for PSK Reporter
+};
+
+void config_default(struct config *c);
+int config_load(struct config *c, const char *path);
+int32_t config_snap(const struct config *c, int32_t freq, int32_t *bfreq);
+int32_t filter_check(const struct filter *f, double sync, int32_t snr, double dt);
+
+#endif
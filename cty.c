@@ -0,0 +1,316 @@
+/* DXCC entity resolution, see cty.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "cty.h"
+
+#define SYMBOLS 37 // '/', 0-9 and A-Z, in ASCII order
+
+/* Children are contiguous and in symbol order, so the child for symbol
+   s is first + number of children with a lower symbol, counted with
+   one popcount over the child bitmap. */
+struct cty_node {
+  uint64_t children; // Bit s set if a child for symbol s exists
+  uint32_t first;    // Index of first child
+  uint32_t value;    // Match index + 1, 0 if no prefix ends here
+};
+
+struct build_node {
+  int32_t child[SYMBOLS];
+  uint32_t value;
+};
+
+struct build {
+  struct build_node *node;
+  uint32_t count;
+  uint32_t size;
+};
+
+static const struct cty_match none = { CTY_NONE, 0, 0 };
+
+static int symbol(char c) {
+  if(c == '/') return 0;
+  if(c >= '0' && c <= '9') return 1 + c - '0';
+  if(c >= 'A' && c <= 'Z') return 11 + c - 'A';
+  return -1;
+}
+
+static int32_t build_new(struct build *b) {
+  struct build_node *node;
+
+  if(b->count == b->size) {
+    if((node = realloc(b->node, 2 * b->size * sizeof(*node))) == NULL) return -1;
+    b->node = node;
+    b->size *= 2;
+  }
+  memset(&b->node[b->count], -1, sizeof(b->node[0].child));
+  b->node[b->count].value = 0;
+  return b->count++;
+}
+
+static int build_insert(struct build *b, const char *prefix, uint32_t value) {
+  int32_t n = 0, s, child;
+
+  for(; *prefix; prefix++) {
+    if((s = symbol(*prefix)) < 0) return 0; // Ignore odd characters
+    if((child = b->node[n].child[s]) < 0) {
+      if((child = build_new(b)) < 0) return -1;
+      b->node[n].child[s] = child;
+    }
+    n = child;
+  }
+  b->node[n].value = value;
+  return 0;
+}
+
+// Lay the trie out breadth first so each node's children are contiguous
+static int pack(struct cty *c, const struct build *b) {
+  uint32_t *queue, head = 0, tail = 1, i;
+  int32_t s;
+
+  c->node = malloc(b->count * sizeof(*c->node));
+  if((queue = malloc(b->count * sizeof(*queue))) == NULL || c->node == NULL) {
+    free(queue);
+    return -1;
+  }
+
+  queue[0] = 0;
+  while(head < tail) {
+    i = head;
+    c->node[i].value = b->node[queue[i]].value;
+    c->node[i].first = tail;
+    c->node[i].children = 0;
+    for(s = 0; s < SYMBOLS; s++) {
+      if(b->node[queue[i]].child[s] < 0) continue;
+      queue[tail++] = b->node[queue[i]].child[s];
+      c->node[i].children |= 1ull << s;
+    }
+    head++;
+  }
+
+  c->nodes = b->count;
+  free(queue);
+  return 0;
+}
+
+// Copy the next ':' terminated field, trimmed
+static char *field(char *p, char *out, size_t size) {
+  char *end = strchr(p, ':'), *q;
+
+  if(end == NULL) return NULL;
+  while(p < end && isspace((uint8_t)*p)) p++;
+  for(q = end; q > p && isspace((uint8_t)q[-1]); q--);
+  snprintf(out, size, "%.*s", (int)(q - p), p);
+  return end + 1;
+}
+
+static int add_match(struct cty *c, uint16_t entity, uint8_t cq, uint8_t itu) {
+  struct cty_match *match;
+
+  if((c->matches & (c->matches - 1)) == 0 && c->matches >= 256) {
+    if((match = realloc(c->match, 2 * c->matches * sizeof(*match))) == NULL) return -1;
+    c->match = match;
+  }
+  c->match[c->matches].entity = entity;
+  c->match[c->matches].cq = cq;
+  c->match[c->matches].itu = itu;
+  return c->matches++;
+}
+
+/* One alias such as "=VE2EM(5)[9]", "3B6" or "VE1<45.0/63.0>{NA}".
+   Only zone overrides are kept, the entity supplies the rest. */
+static int add_alias(struct cty *c, struct build *b, char *alias, uint16_t entity) {
+  char call[16], *p = alias;
+  uint32_t n = 0, id, *exact;
+  int exact_call = 0, m, cq = c->entity[entity].cq, itu = c->entity[entity].itu;
+
+  if(*p == '=') {
+    exact_call = 1;
+    p++;
+  }
+  while(*p && symbol(*p) >= 0 && n < sizeof(call) - 1) call[n++] = *p++;
+  call[n] = 0;
+  if(!n) return 0;
+
+  for(; *p; p++) {
+    if(*p == '(') cq = atoi(p + 1);
+    else if(*p == '[') itu = atoi(p + 1);
+  }
+
+  if((m = add_match(c, entity, cq, itu)) < 0) return -1;
+
+  if(!exact_call) return build_insert(b, call, m + 1);
+
+  if((id = intern_call(&c->exact, call)) == INTERN_NONE) return -1;
+  if(id >= c->exact.count - 1 && (id & (id - 1)) == 0 && id >= 256) {
+    if((exact = realloc(c->exact_match, 2 * id * sizeof(*exact))) == NULL) return -1;
+    c->exact_match = exact;
+  }
+  c->exact_match[id] = m;
+  return 0;
+}
+
+int cty_load(struct cty *c, const char *path) {
+  struct build b = { NULL, 0, 1024 };
+  struct cty_entity *e;
+  char *text = NULL, *p, *end, *alias, cq[8], itu[8], lat[16], lon[16], tz[16];
+  long size;
+  FILE *fp;
+
+  memset(c, 0, sizeof(*c));
+
+  if((fp = fopen(path, "r")) == NULL) {
+    fprintf(stderr, "Cannot open %s.\n", path);
+    return -1;
+  }
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  rewind(fp);
+  if(size <= 0 || (text = malloc(size + 1)) == NULL || fread(text, 1, size, fp) != (size_t)size) {
+    fprintf(stderr, "Cannot read %s.\n", path);
+    fclose(fp);
+    free(text);
+    return -1;
+  }
+  fclose(fp);
+  text[size] = 0;
+
+  c->entity = malloc(512 * sizeof(*c->entity));
+  c->match = malloc(256 * sizeof(*c->match));
+  c->exact_match = malloc(256 * sizeof(*c->exact_match));
+  b.node = malloc(b.size * sizeof(*b.node));
+  if(c->entity == NULL || c->match == NULL || c->exact_match == NULL || b.node == NULL
+      || intern_init(&c->exact, 1024) < 0 || build_new(&b) < 0) goto fail;
+
+  for(p = text; *p;) {
+    while(isspace((uint8_t)*p)) p++;
+    if(!*p) break;
+
+    if(c->entities == CTY_NONE) goto fail;
+    if(c->entities >= 512 && (c->entities & (c->entities - 1)) == 0) {
+      if((e = realloc(c->entity, 2 * c->entities * sizeof(*e))) == NULL) goto fail;
+      c->entity = e;
+    }
+    e = &c->entity[c->entities];
+
+    // Name: CQ: ITU: Continent: Lat: Lon: TZ: Prefix:
+    if((p = field(p, e->name, sizeof(e->name))) == NULL
+        || (p = field(p, cq, sizeof(cq))) == NULL
+        || (p = field(p, itu, sizeof(itu))) == NULL
+        || (p = field(p, e->continent, sizeof(e->continent))) == NULL
+        || (p = field(p, lat, sizeof(lat))) == NULL
+        || (p = field(p, lon, sizeof(lon))) == NULL
+        || (p = field(p, tz, sizeof(tz))) == NULL
+        || (p = field(p, e->prefix, sizeof(e->prefix))) == NULL) goto syntax;
+
+    if(e->prefix[0] == '*') memmove(e->prefix, e->prefix + 1, strlen(e->prefix));
+    e->cq = atoi(cq);
+    e->itu = atoi(itu);
+    e->lat = atof(lat);
+    e->lon = -atof(lon);
+
+    if((end = strchr(p, ';')) == NULL) goto syntax;
+    *end = 0;
+    for(alias = strtok(p, ", \t\r\n"); alias != NULL; alias = strtok(NULL, ", \t\r\n"))
+      if(add_alias(c, &b, alias, c->entities) < 0) goto fail;
+    p = end + 1;
+
+    c->entities++;
+  }
+
+  if(pack(c, &b) < 0) goto fail;
+
+  free(b.node);
+  free(text);
+  return 0;
+
+syntax:
+  fprintf(stderr, "Syntax error in %s near entity %u.\n", path, c->entities + 1);
+  goto cleanup;
+fail:
+  fprintf(stderr, "Cannot allocate memory for %s.\n", path);
+cleanup:
+  free(b.node);
+  free(text);
+  cty_free(c);
+  return -1;
+}
+
+void cty_free(struct cty *c) {
+  free(c->entity);
+  free(c->match);
+  free(c->node);
+  free(c->exact_match);
+  intern_free(&c->exact);
+  memset(c, 0, sizeof(*c));
+}
+
+// Longest prefix of call present in the trie
+static const struct cty_match *longest(const struct cty *c, const char *call) {
+  const struct cty_node *node = c->node;
+  uint32_t best = 0;
+  uint64_t bit;
+  int s;
+
+  if(node == NULL) return &none;
+
+  for(; *call; call++) {
+    if((s = symbol(*call)) < 0 || !(node->children & (bit = 1ull << s))) break;
+    node = &c->node[node->first + __builtin_popcountll(node->children & (bit - 1))];
+    if(node->value) best = node->value;
+  }
+
+  return best ? &c->match[best - 1] : &none;
+}
+
+static const struct cty_match *exact(const struct cty *c, const char *call) {
+  uint32_t id = intern_find(&c->exact, call);
+  return id == INTERN_NONE ? NULL : &c->match[c->exact_match[id]];
+}
+
+// Suffixes that do not change the entity
+static int operating_suffix(const char *s) {
+  static const char *suffix[] = { "P", "M", "A", "B", "QRP", "QRPP", "LH", "R", "J", NULL };
+  int i;
+
+  for(i = 0; suffix[i]; i++)
+    if(strcmp(s, suffix[i]) == 0) return 1;
+  return 0;
+}
+
+const struct cty_match *cty_lookup(const struct cty *c, const char *call) {
+  const struct cty_match *m;
+  char buffer[16], *part[4], *p, *save;
+  int n = 0, i;
+
+  if((m = exact(c, call)) != NULL) return m;
+  if(strchr(call, '/') == NULL) return longest(c, call);
+
+  snprintf(buffer, sizeof(buffer), "%s", call);
+  for(p = strtok_r(buffer, "/", &save); p != NULL && n < 4; p = strtok_r(NULL, "/", &save)) part[n++] = p;
+  if(n == 0) return &none;
+
+  // Maritime and aeronautical mobile are outside any entity
+  if(strcmp(part[n - 1], "MM") == 0 || strcmp(part[n - 1], "AM") == 0) return &none;
+  while(n > 1 && operating_suffix(part[n - 1])) n--;
+
+  if(n == 1) {
+    if((m = exact(c, part[0])) != NULL) return m;
+    return longest(c, part[0]);
+  }
+
+  // K1ABC/4 operates from call area 4
+  if(strlen(part[n - 1]) == 1 && isdigit((uint8_t)part[n - 1][0])) {
+    for(p = part[0]; *p && !isdigit((uint8_t)*p); p++);
+    if(*p) *p = part[n - 1][0];
+    return longest(c, part[0]);
+  }
+
+  // Otherwise the shorter part is the prefix, EA8/DL1ABC or DL1ABC/EA8
+  for(i = 1, p = part[0]; i < n; i++)
+    if(strlen(part[i]) < strlen(p)) p = part[i];
+  return longest(c, p);
+}
@@ -0,0 +1,50 @@
+/* DXCC entity resolution from the standard cty.dat prefix file.
+   Prefixes are kept in a packed trie searched for the longest match,
+   whole call exceptions (=CALL entries) in an interning table. Calls
+   with a portable prefix or suffix are reduced to the part that
+   decides the entity before the lookup.
+   */
+
+#ifndef CTY_H
+#define CTY_H
+
+#include <stdint.h>
+
+#include "intern.h"
+
+#define CTY_NONE 0xffff   // Entity of calls that resolve to nothing, e.g. /MM
+
+struct cty_entity {
+  char name[32];
+  char prefix[8];         // Primary prefix, without a leading *
+  char continent[4];
+  uint8_t cq;             // CQ zone
+  uint8_t itu;            // ITU zone
+  float lat;              // Degrees, north positive
+  float lon;              // Degrees, east positive (cty.dat stores west positive)
+};
+
+struct cty_match {
+  uint16_t entity;        // Index into entity, CTY_NONE if none
+  uint8_t cq;             // Zones after per prefix overrides
+  uint8_t itu;
+};
+
+struct cty_node;
+
+struct cty {
+  struct cty_entity *entity;
+  uint32_t entities;
+  struct cty_match *match; // Match per prefix or exception
+  uint32_t matches;
+  struct cty_node *node;   // Packed trie, node 0 is the root
+  uint32_t nodes;
+  struct intern exact;     // Whole call exceptions
+  uint32_t *exact_match;   // Match index per exact call id
+};
+
+int cty_load(struct cty *c, const char *path);
+void cty_free(struct cty *c);
+const struct cty_match *cty_lookup(const struct cty *c, const char *call);
+
+#endif
@@ -0,0 +1,538 @@
+/* Resident uploader around a single epoll loop, see daemon.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+
+#include "daemon.h"
+#include "metrics.h"
+
+enum { EV_WATCH, EV_FIFO, EV_LISTEN, EV_SHM, EV_SLOT, EV_HEARTBEAT, EV_PACE, EV_SEND, EV_SIGNAL };
+
+#define LINE_MAX_LEN 64               // Same limit as the one-shot fgets()
+
+struct line_buf {
+  char data[4096];
+  size_t used;
+};
+
+struct loop {
+  int epfd;
+  int watch, fifo, listen, shm_event, slot, heartbeat, pace, signal;
+  int send_armed;                     // EPOLLOUT requested on the send socket
+  double offset, period;              // Slot timer phase and interval in seconds
+  struct pipeline *pipeline;          // Stage threads, NULL if inline
+  struct line_buf fifo_buf;
+  struct shmring shm;                 // Decoder's spot ring, ring NULL if unused
+  pthread_t shm_thread;
+  sem_t shm_drained;                  // Posted by the loop after each pass the waiter asked for
+  _Atomic int shm_stop;
+  double saved;                       // Slot boundary of the last save in low wakeup mode
+  uint64_t cpu_us, wakeups;           // Process totals at the last slot
+  uint64_t start_us, start_cpu_us, start_wakeups;
+};
+
+static int watch_fd(struct loop *l, int fd, uint32_t tag, uint32_t events) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.u32 = tag;
+  return epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int take_line(struct uploader *u, struct loop *l, char *line) {
+  return l->pipeline != NULL ? pipeline_line(l->pipeline, line) : uploader_line(u, line);
+}
+
+// Hand a line to the parser with the length the one-shot mode allowed
+static int feed_line(struct uploader *u, struct loop *l, const char *src, size_t size) {
+  char line[LINE_MAX_LEN];
+
+  if(size > LINE_MAX_LEN - 1) size = LINE_MAX_LEN - 1;
+  memcpy(line, src, size);
+  line[size] = 0;
+  return take_line(u, l, line);
+}
+
+// Parse every complete line in buf, keep the partial tail
+static int feed_buffer(struct uploader *u, struct loop *l, struct line_buf *b) {
+  char *start = b->data, *end;
+
+  while((end = memchr(start, '\n', b->data + b->used - start)) != NULL) {
+    if(feed_line(u, l, start, end - start) < 0) return -1;
+    start = end + 1;
+  }
+
+  b->used -= start - b->data;
+  memmove(b->data, start, b->used);
+  if(b->used == sizeof(b->data)) b->used = 0; // Line too long, drop it
+  return 0;
+}
+
+// Plain read() into a line buffer, fopen() would allocate for every file
+static int read_file(struct uploader *u, struct loop *l, const char *dir, const char *name) {
+  char path[4096];
+  struct line_buf b;
+  ssize_t size;
+  int fd, rc = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if((fd = open(path, O_RDONLY)) < 0) {
+    fprintf(stderr, "Cannot open input file %s.\n", path);
+    return 0;
+  }
+
+  b.used = 0;
+  while(rc == 0 && (size = read(fd, b.data + b.used, sizeof(b.data) - b.used)) > 0) {
+    b.used += size;
+    rc = feed_buffer(u, l, &b);
+  }
+  if(rc == 0 && b.used) rc = feed_line(u, l, b.data, b.used); // Last line without a newline
+  close(fd);
+  return rc;
+}
+
+static int on_watch(struct uploader *u, struct loop *l, const char *dir) {
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *e;
+  ssize_t size;
+  char *p;
+
+  while((size = read(l->watch, events, sizeof(events))) > 0)
+    for(p = events; p < events + size; p += sizeof(*e) + e->len) {
+      e = (const struct inotify_event *)p;
+      if(!e->len || e->name[0] == '.' || (e->mask & IN_ISDIR)) continue; // Skip files still being written
+      if(read_file(u, l, dir, e->name) < 0) return -1;
+    }
+
+  return 0;
+}
+
+static int on_fifo(struct uploader *u, struct loop *l) {
+  struct line_buf *b = &l->fifo_buf;
+  ssize_t size;
+
+  while((size = read(l->fifo, b->data + b->used, sizeof(b->data) - b->used)) > 0) {
+    b->used += size;
+    if(feed_buffer(u, l, b) < 0) return -1;
+  }
+
+  return 0;
+}
+
+static int on_listen(struct uploader *u, struct loop *l) {
+  struct line_buf b;
+  ssize_t size;
+
+  while((size = recv(l->listen, b.data, sizeof(b.data) - 1, 0)) > 0) {
+    if(b.data[size - 1] != '\n') b.data[size++] = '\n'; // A datagram always ends its last line
+    b.used = size;
+    if(feed_buffer(u, l, &b) < 0) return -1;
+  }
+
+  return 0;
+}
+
+// Sleeps on the spot ring's futex and makes shm_event readable for
+// epoll whenever the producer moved past what the loop read. It only
+// sleeps again once the loop drained the ring, so while records keep
+// coming the producer sees nobody waiting and makes no system call.
+// The eventfd starts readable, which is the first pass to wait for.
+static void *shm_waiter(void *arg) {
+  struct loop *l = arg;
+  uint32_t seen;
+  uint64_t one = 1;
+
+  for(;;) {
+    while(sem_wait(&l->shm_drained) < 0 && errno == EINTR);
+    if(atomic_load(&l->shm_stop)) break;
+    seen = l->shm.tail_cache; // The loop found the ring empty up to here
+    while(shmring_wait(&l->shm, seen) == seen)
+      if(atomic_load(&l->shm_stop)) return NULL;
+    if(write(l->shm_event, &one, sizeof(one)) < 0) break;
+  }
+
+  return NULL;
+}
+
+static int on_shm(struct uploader *u, struct loop *l) {
+  struct shm_record r;
+  struct spot s;
+  uint64_t count;
+  int woken = 0;
+
+  if(l->shm_event >= 0) {
+    if(read(l->shm_event, &count, sizeof(count)) == sizeof(count)) woken = 1;
+    else if(errno != EAGAIN) return 0;
+  }
+
+  while(shmring_pop(&l->shm, &r)) {
+    // The producer is another process, its strings are not trusted
+    r.call[sizeof(r.call) - 1] = 0;
+    r.grid[sizeof(r.grid) - 1] = 0;
+    if(l->pipeline != NULL) {
+      if(pipeline_record(l->pipeline, &r) < 0) return -1;
+    }
+    else if(uploader_decode(u, &s, r.time, r.sync, r.snr, r.dt, r.freq, r.call, r.grid)
+        && uploader_add(u, &s) < 0) return -1;
+  }
+
+  if(woken) sem_post(&l->shm_drained);
+  return 0;
+}
+
+// Drain the send queue as far as pacing and the socket allow
+static int pump(struct uploader *u, struct loop *l) {
+  struct itimerspec its;
+  struct epoll_event ev;
+  int rc, want;
+
+  if((rc = sender_pump(&u->sender)) < 0) return -1;
+  if(rc == SENDER_IDLE) sender_burst_end(&u->sender);
+
+  if(rc == SENDER_GAP) {
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = u->sender.not_before / 1000000;
+    its.it_value.tv_nsec = u->sender.not_before % 1000000 * 1000;
+    timerfd_settime(l->pace, TFD_TIMER_ABSTIME, &its, NULL);
+  }
+
+  want = rc == SENDER_BLOCKED;
+  if(want != l->send_armed) {
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want ? EPOLLOUT : 0;
+    ev.data.u32 = EV_SEND;
+    epoll_ctl(l->epfd, EPOLL_CTL_MOD, u->sender.sock, &ev);
+    l->send_armed = want;
+  }
+
+  return 0;
+}
+
+// Queue the batch, its datagrams go out as one burst
+static int send_batch(struct uploader *u) {
+  if(uploader_send(u) < 0) return -1;
+  if(sender_pending(&u->sender)) sender_burst_begin(&u->sender);
+  return 0;
+}
+
+// Low wakeup mode: read what the inputs buffered since the last slot,
+// then send the burst in place instead of waking for every gap
+static int drain(struct uploader *u, struct loop *l, const struct daemon_opts *o) {
+  if((l->watch >= 0 && on_watch(u, l, o->watch_dir) < 0)
+      || (l->fifo >= 0 && on_fifo(u, l) < 0)
+      || (l->listen >= 0 && on_listen(u, l) < 0)
+      || (l->shm.ring != NULL && on_shm(u, l) < 0)) return -1;
+  return 0;
+}
+
+static int send_now(struct uploader *u) {
+  if(send_batch(u) < 0 || sender_flush(&u->sender) < 0) return -1;
+  sender_burst_end(&u->sender);
+  return 0;
+}
+
+// CPU time and voluntary context switches, each a sleep that ended in a wakeup
+static void usage(uint64_t *cpu_us, uint64_t *wakeups) {
+  struct rusage ru;
+
+  memset(&ru, 0, sizeof(ru));
+  getrusage(RUSAGE_SELF, &ru);
+  *cpu_us = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+  *wakeups = ru.ru_nvcsw;
+}
+
+// Wakeups and CPU time of the slot just over, for checking that the
+// process stays asleep between slots
+static void report_usage(struct loop *l) {
+  uint64_t cpu_us, wakeups;
+
+  usage(&cpu_us, &wakeups);
+  metrics_set("rbn_cpu_seconds_per_slot", (cpu_us - l->cpu_us) / 1e6);
+  metrics_set("rbn_wakeups_per_minute", (wakeups - l->wakeups) * 60 / l->period);
+  l->cpu_us = cpu_us;
+  l->wakeups = wakeups;
+}
+
+static void to_timespec(double t, struct timespec *ts) {
+  ts->tv_sec = (time_t)t;
+  ts->tv_nsec = (long)((t - ts->tv_sec) * 1e9);
+}
+
+// Start of the slot boundary the slot timer last fired for
+static double boundary(const struct loop *l) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return floor((ts.tv_sec + ts.tv_nsec / 1e9 - l->offset) / l->period) * l->period;
+}
+
+static int open_listen(const char *spec) {
+  struct sockaddr_in addr;
+  char host[64];
+  const char *colon = strrchr(spec, ':');
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(atoi(colon != NULL ? colon + 1 : spec));
+  if(colon != NULL) {
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+    addr.sin_addr.s_addr = inet_addr(host);
+  }
+
+  if((fd = socket(PF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP)) < 0
+      || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "Cannot listen on %s.\n", spec);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// Slot boundaries plus the offset on the wall clock, heartbeat on the
+// monotonic one unless saves ride on the slot timer
+static int open_timers(struct loop *l, int lowpower) {
+  struct itimerspec its;
+  struct timespec now;
+
+  if((l->slot = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) < 0
+      || (l->heartbeat = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0
+      || (l->pace = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0) return -1;
+
+  memset(&its, 0, sizeof(its));
+  clock_gettime(CLOCK_REALTIME, &now);
+  to_timespec((floor((now.tv_sec + now.tv_nsec / 1e9 - l->offset) / l->period) + 1) * l->period + l->offset, &its.it_value);
+  to_timespec(l->period, &its.it_interval);
+  if(timerfd_settime(l->slot, TFD_TIMER_ABSTIME, &its, NULL) < 0) return -1;
+
+  its.it_value.tv_sec = its.it_interval.tv_sec = lowpower ? 0 : DAEMON_HEARTBEAT;
+  return timerfd_settime(l->heartbeat, 0, &its, NULL);
+}
+
+int daemon_run(struct uploader *u, const struct daemon_opts *o) {
+  struct epoll_event events[16];
+  struct signalfd_siginfo si;
+  struct loop l;
+  sigset_t mask;
+  uint64_t expirations;
+  uint32_t slot, next;
+  int i, n, running = 1, rc = 0, inputs;
+
+  memset(&l, 0, sizeof(l));
+  l.epfd = l.watch = l.fifo = l.listen = l.shm_event = l.slot = l.heartbeat = l.pace = l.signal = -1;
+  l.pipeline = o->pipeline;
+  l.offset = o->deadline >= 0 ? o->deadline : 0;
+  l.period = o->deadline >= 0 ? o->period : SLOT_SECONDS;
+  if(o->deadline >= 0) u->sender.burst_limit = l.period * 1e6;
+  inputs = o->lowpower ? 0 : EPOLLIN; // Low wakeup mode only reads inputs on the slot timer
+
+  // Sleeps in the burst may be merged with other timers, a full send queue is flushed
+  if(o->lowpower) {
+    prctl(PR_SET_TIMERSLACK, DAEMON_SLACK_NS);
+    u->sender.blocking = 1;
+    u->grouped = 1;
+    l.saved = boundary(&l);
+  }
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGHUP);
+  signal(SIGPIPE, SIG_IGN);
+
+  if((l.epfd = epoll_create1(0)) < 0 || sigprocmask(SIG_BLOCK, &mask, NULL) < 0
+      || (l.signal = signalfd(-1, &mask, SFD_NONBLOCK)) < 0 || open_timers(&l, o->lowpower) < 0) {
+    fprintf(stderr, "Cannot set up event loop.\n");
+    rc = -1;
+    goto done;
+  }
+
+  if(o->watch_dir != NULL && ((l.watch = inotify_init1(IN_NONBLOCK)) < 0
+      || inotify_add_watch(l.watch, o->watch_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+    fprintf(stderr, "Cannot watch directory %s.\n", o->watch_dir);
+    rc = -1;
+    goto done;
+  }
+
+  // Opened read-write so the FIFO never reports end of file between writers
+  if(o->fifo_path != NULL) {
+    if(mkfifo(o->fifo_path, 0644) < 0 && errno != EEXIST) l.fifo = -1;
+    else l.fifo = open(o->fifo_path, O_RDWR | O_NONBLOCK);
+    if(l.fifo < 0) {
+      fprintf(stderr, "Cannot open FIFO %s.\n", o->fifo_path);
+      rc = -1;
+      goto done;
+    }
+    if(o->lowpower) fcntl(l.fifo, F_SETPIPE_SZ, DAEMON_INPUT_BUFFER); // A slot of lines without blocking the writer
+  }
+
+  if(o->listen_addr != NULL && (l.listen = open_listen(o->listen_addr)) < 0) {
+    rc = -1;
+    goto done;
+  }
+  if(l.listen >= 0 && o->lowpower) {
+    n = DAEMON_INPUT_BUFFER;
+    setsockopt(l.listen, SOL_SOCKET, SO_RCVBUF, &n, sizeof(n));
+  }
+
+  // Records already waiting in the ring are read on the first pass.
+  // In low wakeup mode nobody sleeps on the ring, so the decoder never wakes us.
+  if(o->shm_name != NULL && shmring_open(&l.shm, o->shm_name) < 0) {
+    rc = -1;
+    goto done;
+  }
+  if(o->shm_name != NULL && !o->lowpower) {
+    sem_init(&l.shm_drained, 0, 0);
+    if((l.shm_event = eventfd(1, EFD_NONBLOCK)) < 0
+        || pthread_create(&l.shm_thread, NULL, shm_waiter, &l) != 0) {
+      fprintf(stderr, "Cannot start spot ring reader.\n");
+      if(l.shm_event >= 0) close(l.shm_event);
+      sem_destroy(&l.shm_drained);
+      l.shm_event = -1; // No waiter to stop
+      rc = -1;
+      goto done;
+    }
+  }
+
+  if((l.watch >= 0 && watch_fd(&l, l.watch, EV_WATCH, inputs) < 0)
+      || (l.fifo >= 0 && watch_fd(&l, l.fifo, EV_FIFO, inputs) < 0)
+      || (l.listen >= 0 && watch_fd(&l, l.listen, EV_LISTEN, inputs) < 0)
+      || (l.shm_event >= 0 && watch_fd(&l, l.shm_event, EV_SHM, EPOLLIN) < 0)
+      || watch_fd(&l, l.slot, EV_SLOT, EPOLLIN) < 0
+      || watch_fd(&l, l.heartbeat, EV_HEARTBEAT, EPOLLIN) < 0
+      || watch_fd(&l, l.pace, EV_PACE, EPOLLIN) < 0
+      || watch_fd(&l, l.signal, EV_SIGNAL, EPOLLIN) < 0
+      || watch_fd(&l, u->sender.sock, EV_SEND, 0) < 0) {
+    fprintf(stderr, "Cannot set up event loop.\n");
+    rc = -1;
+    goto done;
+  }
+
+  usage(&l.cpu_us, &l.wakeups);
+  l.start_us = monotonic_us();
+  l.start_cpu_us = l.cpu_us;
+  l.start_wakeups = l.wakeups;
+
+  while(running && rc == 0) {
+    if((n = epoll_wait(l.epfd, events, 16, -1)) < 0) {
+      if(errno == EINTR) continue;
+      fprintf(stderr, "epoll_wait() failed.\n");
+      rc = -1;
+      break;
+    }
+
+    for(i = 0; i < n && rc == 0; i++)
+      switch(events[i].data.u32) {
+        case EV_WATCH: rc = on_watch(u, &l, o->watch_dir); break;
+        case EV_FIFO: rc = on_fifo(u, &l); break;
+        case EV_LISTEN: rc = on_listen(u, &l); break;
+        case EV_SHM: rc = on_shm(u, &l); break;
+        case EV_SLOT:
+          if(read(l.slot, &expirations, sizeof(expirations)) < 0) break;
+          slot = uploader_slot(u, boundary(&l) - l.period);
+          next = o->deadline >= 0 ? uploader_slot(u, boundary(&l)) : 0;
+          if(l.shm.ring != NULL) metrics_set("rbn_shm_dropped_total", shmring_dropped(&l.shm));
+          report_usage(&l);
+          // A scheduled daemon sends the slot's spots here as one burst
+          if(l.pipeline != NULL) {
+            if(o->deadline >= 0) pipeline_mark(l.pipeline, PIPE_END, 0);
+            pipeline_tick(l.pipeline, slot, next);
+            pipeline_mark(l.pipeline, PIPE_RELOAD, slot);
+          } else {
+            if(o->lowpower && (rc = drain(u, &l, o)) == 0) rc = send_now(u);
+            else if(o->deadline >= 0) rc = send_batch(u);
+            uploader_rollover(u);
+            if(next) u->deadline = next; // Later spots of it missed the burst
+            uploader_tick(u, slot);
+            uploader_swap(u);
+          }
+          if(o->lowpower && boundary(&l) - l.saved >= DAEMON_HEARTBEAT) {
+            l.saved = boundary(&l);
+            uploader_save(u);
+          }
+          break;
+        case EV_HEARTBEAT:
+          if(read(l.heartbeat, &expirations, sizeof(expirations)) < 0) break;
+          if(l.pipeline != NULL) pipeline_mark(l.pipeline, PIPE_SAVE, 0);
+          else uploader_save(u);
+          break;
+        case EV_PACE:
+          if(read(l.pace, &expirations, sizeof(expirations)) < 0) break;
+          break;
+        case EV_SEND: break;
+        case EV_SIGNAL:
+          while(read(l.signal, &si, sizeof(si)) == sizeof(si)) {
+            if(si.ssi_signo == SIGHUP) uploader_reload(u);
+            else if(si.ssi_signo != SIGUSR1) running = 0;
+            else if(l.pipeline != NULL) pipeline_mark(l.pipeline, PIPE_DUMP, 0);
+            else uploader_dump(u);
+          }
+          break;
+      }
+
+    // Unscheduled, whatever arrived goes out before the loop sleeps again
+    if(o->deadline < 0 && l.pipeline != NULL) pipeline_mark(l.pipeline, PIPE_END, 0);
+    else if(o->deadline < 0 && rc == 0) rc = send_batch(u);
+    if(rc == 0 && l.pipeline == NULL) rc = pump(u, &l);
+  }
+
+  if(rc == 0 && o->lowpower) rc = drain(u, &l, o);
+  if(rc == 0 && l.pipeline == NULL && o->deadline >= 0) rc = send_batch(u); // Spots held for the next burst
+  if(rc == 0 && l.pipeline == NULL) rc = sender_flush(&u->sender);
+
+  if(u->verbose) {
+    usage(&l.cpu_us, &l.wakeups);
+    printf("Wakeups: %.1f per minute, CPU time: %.1f ms per slot\n",
+      (l.wakeups - l.start_wakeups) * 60e6 / (monotonic_us() - l.start_us + 1),
+      (l.cpu_us - l.start_cpu_us) / 1e3 * l.period * 1e6 / (monotonic_us() - l.start_us + 1));
+  }
+
+  // Setup failures land here too, with whatever was opened so far
+done:
+  if(l.watch >= 0) close(l.watch);
+  if(l.fifo >= 0) close(l.fifo);
+  if(l.listen >= 0) close(l.listen);
+  if(l.shm_event >= 0) {
+    // The waiter may check the flag just before it sleeps, keep waking it
+    atomic_store(&l.shm_stop, 1);
+    sem_post(&l.shm_drained);
+    for(;;) {
+      shmring_wake(&l.shm);
+      if(pthread_tryjoin_np(l.shm_thread, NULL) != EBUSY) break;
+      usleep(1000);
+    }
+    sem_destroy(&l.shm_drained);
+    close(l.shm_event);
+  }
+  if(l.shm.ring != NULL) shmring_close(&l.shm);
+  if(l.slot >= 0) close(l.slot);
+  if(l.heartbeat >= 0) close(l.heartbeat);
+  if(l.pace >= 0) close(l.pace);
+  if(l.signal >= 0) close(l.signal);
+  if(l.epfd >= 0) close(l.epfd);
+
+  return rc;
+}
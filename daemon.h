@@ -0,0 +1,43 @@
+/* Resident uploader around a single epoll loop.
+   Decode lines arrive from files closed in a watched directory, a FIFO
+   or a UDP socket, binary decodes from a decoder's shared memory ring,
+   and are parsed and queued as soon as they arrive.
+   Timers on slot boundaries and a heartbeat do the periodic work, the
+   send queue is drained whenever its pacing gap passes or the socket
+   becomes writable again. With a deadline spots are held back and the
+   slot timer fires that long after each slot boundary instead, so a
+   slot goes out as one paced burst once its decodes are all in.
+   In low wakeup mode for boards on solar power nothing but the slot
+   timer wakes the process: inputs wait in their kernel buffers and
+   are read at the deadline, the burst goes out grouped by band and
+   state is saved on the same wakeup.
+   SIGINT and SIGTERM end the loop cleanly, SIGUSR1 writes the CSV
+   reports, SIGHUP rereads the config file and swaps it in at the next
+   slot boundary. With a pipeline the loop is only the reader stage and
+   passes lines and timer events on as marks.
+   */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "uploader.h"
+#include "pipeline.h"
+
+#define DAEMON_HEARTBEAT 60       // Seconds between state saves
+#define DAEMON_SLACK_NS 1000000   // Timer slack in low wakeup mode, pacing gaps may stretch by this
+#define DAEMON_INPUT_BUFFER (1 << 20) // FIFO and UDP buffer for a slot of input in low wakeup mode
+
+struct daemon_opts {
+  char *watch_dir;                // Directory of decode files, NULL if unused
+  char *fifo_path;                // FIFO of decode lines, NULL if unused
+  char *listen_addr;              // [address:]port for UDP decode lines, NULL if unused
+  char *shm_name;                 // Shared memory ring of binary decodes, NULL if unused
+  struct pipeline *pipeline;      // Hand lines to the stage threads, NULL to run inline
+  double deadline;                // Send each slot this many seconds after its end, < 0 to send at once
+  double period;                  // Slot length in seconds for deadline, 15 for FT8, 7.5 for FT4
+  int lowpower;                   // One wakeup per slot, needs a deadline and no pipeline
+};
+
+int daemon_run(struct uploader *u, const struct daemon_opts *o);
+
+#endif
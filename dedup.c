@@ -0,0 +1,146 @@
+/* Host wide duplicate spot suppression, see dedup.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dedup.h"
+#include "batch.h"
+
+#define DEDUP_MAGIC 0x52424e44 // "RBND"
+#define DEDUP_PROBES 32        // Give up and send when the chain is longer
+
+/* Entry word: 40-bit key hash in the high bits, 24-bit slot number of
+   the last claim in the low bits (wraps after eight years). Zero means
+   the entry was never used. */
+#define KEY(e)   ((e) >> 24)
+#define EPOCH(e) ((uint32_t)(e) & 0xffffff)
+
+struct dedup_header {
+  _Atomic uint32_t magic;      // Set last by the creator
+  uint32_t entries;
+  char pad[56];                // Entries start on their own cache line
+};
+
+int dedup_open(struct dedup *d, const char *name, uint32_t entries) {
+  struct stat st;
+  char path[64];
+  int fd, i, created = 0;
+  void *p;
+
+  memset(d, 0, sizeof(*d));
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+
+  if((fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666)) >= 0) {
+    created = 1;
+    (void)fchmod(fd, 0666); // Shared with uploaders run by other users
+    d->length = sizeof(struct dedup_header) + (size_t)entries * sizeof(uint64_t);
+    if(ftruncate(fd, d->length) < 0) goto fail;
+  }
+  else {
+    if(errno != EEXIST || (fd = shm_open(path, O_RDWR, 0)) < 0) goto fail;
+    // Creator may still be sizing the segment
+    for(i = 0; i < 1000; i++) {
+      if(fstat(fd, &st) < 0) goto fail;
+      if(st.st_size >= (off_t)sizeof(struct dedup_header)) break;
+      usleep(1000);
+    }
+    d->length = st.st_size;
+  }
+
+  if((p = mmap(NULL, d->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) goto fail;
+  close(fd);
+  fd = -1;
+  d->header = p;
+  d->entry = (_Atomic uint64_t *)(d->header + 1);
+
+  if(created) {
+    d->header->entries = entries;
+    atomic_store_explicit(&d->header->magic, DEDUP_MAGIC, memory_order_release);
+  }
+  else {
+    for(i = 0; i < 1000; i++) {
+      if(atomic_load_explicit(&d->header->magic, memory_order_acquire) == DEDUP_MAGIC) break;
+      usleep(1000);
+    }
+    entries = d->header->entries;
+    if(i == 1000 || (entries & (entries - 1))
+        || sizeof(struct dedup_header) + (size_t)entries * sizeof(uint64_t) > d->length) {
+      fprintf(stderr, "Shared memory segment %s is not a dedup table.\n", path);
+      dedup_close(d);
+      return -1;
+    }
+  }
+
+  d->mask = entries - 1;
+  return 0;
+
+fail:
+  fprintf(stderr, "Cannot open shared memory segment %s: %s.\n", path, strerror(errno));
+  if(fd >= 0) close(fd);
+  if(created) shm_unlink(path);
+  return -1;
+}
+
+void dedup_close(struct dedup *d) {
+  if(d->header != NULL) munmap(d->header, d->length);
+  memset(d, 0, sizeof(*d));
+}
+
+// FNV-1a of base frequency and slot on top of the call's hash
+static uint64_t hash_spot(uint64_t call, int32_t bfreq, uint32_t slot) {
+  uint64_t hash = call;
+  uint32_t i, value[2] = { bfreq, slot };
+
+  for(i = 0; i < sizeof(value); i++) {
+    hash ^= ((uint8_t *)value)[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+/* Return 1 if another process already claimed this spot, 0 if the caller
+   claimed it now and should send it. now is the current wall clock time,
+   entries older than DEDUP_TTL slots are free for reuse. */
+int dedup_seen(struct dedup *d, uint64_t call, int32_t bfreq, uint32_t slot, uint32_t now) {
+  uint64_t hash = hash_spot(call, bfreq, slot), key, old, claim;
+  uint32_t i, probe, free_probe, epoch = now / SLOT_SECONDS & 0xffffff;
+  int expired;
+
+  key = hash >> 24 ? hash >> 24 : 1;
+  claim = key << 24 | epoch;
+
+retry:
+  free_probe = DEDUP_PROBES;
+  for(probe = 0; probe < DEDUP_PROBES; probe++) {
+    i = (hash + probe) & d->mask;
+    old = atomic_load_explicit(&d->entry[i], memory_order_acquire);
+    expired = ((epoch - EPOCH(old)) & 0xffffff) >= DEDUP_TTL;
+
+    if(old && KEY(old) == key) {
+      if(!expired) return 1;
+      // Our own stale entry, renew it in place
+      if(atomic_compare_exchange_strong(&d->entry[i], &old, claim)) return 0;
+      goto retry;
+    }
+    if(free_probe == DEDUP_PROBES && (!old || expired)) free_probe = probe;
+    if(!old) break; // End of chain, key cannot be further on
+  }
+
+  if(free_probe == DEDUP_PROBES) return 0; // Chain full, fail open and send
+
+  /* Racing processes pick the same first free entry, the loser sees the
+     winner's claim on retry. */
+  i = (hash + free_probe) & d->mask;
+  old = atomic_load_explicit(&d->entry[i], memory_order_relaxed);
+  if(!(old == 0 || ((epoch - EPOCH(old)) & 0xffffff) >= DEDUP_TTL)
+      || !atomic_compare_exchange_strong(&d->entry[i], &old, claim))
+    goto retry;
+
+  return 0;
+}
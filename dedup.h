@@ -0,0 +1,32 @@
+/* Host wide duplicate spot suppression.
+   Uploader processes on the same host map one table in /dev/shm and
+   claim each (call, base frequency, slot) before sending it. The first
+   process to claim a spot sends it, the others drop it. Entries are
+   single 64-bit words updated with compare-and-swap, no locks are held
+   so a killed process can never wedge the others.
+   */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define DEDUP_ENTRIES 65536 // Table size, 512 kB of shared memory
+#define DEDUP_TTL 8         // Slots an entry lives after its last claim
+
+struct dedup_header;
+
+struct dedup {
+  struct dedup_header *header;
+  _Atomic uint64_t *entry;
+  uint32_t mask;
+  size_t length;            // Mapped bytes
+};
+
+int dedup_open(struct dedup *d, const char *name, uint32_t entries);
+void dedup_close(struct dedup *d);
+int dedup_seen(struct dedup *d, uint64_t call, int32_t bfreq, uint32_t slot, uint32_t now);
+
+#endif
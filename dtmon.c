@@ -0,0 +1,83 @@
+/* Receiver clock health monitor, see dtmon.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "dtmon.h"
+#include "batch.h"
+#include "metrics.h"
+
+void dtmon_init(struct dtmon *m, double threshold) {
+  memset(m, 0, sizeof(*m));
+  m->threshold = threshold;
+}
+
+static void finish(struct dtmon *m, struct dt_slot *s) {
+  uint32_t half = (s->count + 1) / 2, sum = 0;
+  int32_t b, d;
+  double median, mad;
+  struct tm tm;
+  time_t t = s->slot;
+
+  if(s->count >= DT_MIN_DECODES) {
+    for(b = 0; b < DT_BINS && (sum += s->bin[b]) < half; b++);
+
+    // Fold the histogram around the median bin for the absolute deviations
+    for(d = 0, sum = 0; d < DT_BINS; d++) {
+      if(b + d < DT_BINS) sum += s->bin[b + d];
+      if(d && b - d >= 0) sum += s->bin[b - d];
+      if(sum >= half) break;
+    }
+
+    median = (b - DT_BINS / 2) * DT_STEP;
+    mad = d * DT_STEP;
+
+    metrics_set("rbn_dt_median_seconds", median);
+    metrics_set("rbn_dt_mad_seconds", mad);
+    metrics_set("rbn_dt_decodes", s->count);
+    metrics_set("rbn_dt_slot_timestamp_seconds", s->slot);
+
+    if(m->threshold > 0 && fabs(median) > m->threshold) {
+      m->warnings++;
+      metrics_add("rbn_dt_warnings_total", 1);
+      gmtime_r(&t, &tm);
+      fprintf(stderr, "Warning: slot %02d:%02d:%02d median dt %+.2f s (MAD %.2f s, %u decodes), check receiver clock\n",
+        tm.tm_hour, tm.tm_min, tm.tm_sec, median, mad, s->count);
+    }
+  }
+
+  memset(s, 0, sizeof(*s));
+}
+
+void dtmon_add(struct dtmon *m, uint32_t slot, double dt) {
+  struct dt_slot *s = &m->slot[slot / SLOT_SECONDS % DT_SLOTS];
+  int32_t b = (int32_t)floor(dt / DT_STEP + 0.5) + DT_BINS / 2;
+
+  if(s->slot != slot) {
+    if(s->slot > slot) return; // Straggler from a slot already reported
+    if(s->slot) finish(m, s);
+    s->slot = slot;
+  }
+
+  if(b < 0) b = 0;
+  if(b >= DT_BINS) b = DT_BINS - 1;
+  if(s->bin[b] < UINT16_MAX) s->bin[b]++;
+  s->count++;
+}
+
+// Report every slot that started before the given time, oldest first
+void dtmon_flush(struct dtmon *m, uint32_t before) {
+  struct dt_slot *oldest;
+  int32_t i;
+
+  for(;;) {
+    oldest = NULL;
+    for(i = 0; i < DT_SLOTS; i++)
+      if(m->slot[i].slot && m->slot[i].slot < before
+          && (oldest == NULL || m->slot[i].slot < oldest->slot)) oldest = &m->slot[i];
+    if(oldest == NULL) break;
+    finish(m, oldest);
+  }
+}
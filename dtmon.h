@@ -0,0 +1,34 @@
+/* Receiver clock health from decode timing errors.
+   The dt values of every decode in a slot go into a fixed histogram,
+   so median and median absolute deviation need constant memory per
+   slot however many decodes arrive. A drifting receiver clock shows up
+   as a median dt moving away from zero long before decodes disappear.
+   */
+
+#ifndef DTMON_H
+#define DTMON_H
+
+#include <stdint.h>
+
+#define DT_BINS 512           // Histogram bins
+#define DT_STEP 0.01          // Bin width in seconds, covers -2.56 to +2.55 s
+#define DT_SLOTS 8            // Slots tracked at once, decode files interleave slots
+#define DT_MIN_DECODES 5      // Fewer decodes give no verdict
+
+struct dt_slot {
+  uint32_t slot;              // Slot start, 0 if unused
+  uint32_t count;
+  uint16_t bin[DT_BINS];
+};
+
+struct dtmon {
+  double threshold;           // Warn when |median| exceeds this, 0 to disable
+  uint32_t warnings;
+  struct dt_slot slot[DT_SLOTS];
+};
+
+void dtmon_init(struct dtmon *m, double threshold);
+void dtmon_add(struct dtmon *m, uint32_t slot, double dt);
+void dtmon_flush(struct dtmon *m, uint32_t before);
+
+#endif
@@ -0,0 +1,75 @@
+/* Freshness budget, see fresh.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fresh.h"
+#include "metrics.h"
+
+// Upper bounds in seconds, a slot, the time RBN shows a spot and beyond
+static const uint32_t bound[FRESH_BUCKETS] = { 15, 30, 60, 120, 300, 600, 1200, 3600 };
+
+// Stale spots are appended to archive_path, NULL for none
+int fresh_open(struct fresh *f, const char *archive_path) {
+  memset(f, 0, sizeof(*f));
+  f->fd = -1;
+  if(archive_path != NULL && (f->fd = open(archive_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+    fprintf(stderr, "Cannot open archive file %s.\n", archive_path);
+    return -1;
+  }
+  return 0;
+}
+
+void fresh_close(struct fresh *f) {
+  if(f->fd >= 0) close(f->fd);
+  f->fd = -1;
+}
+
+// Age of a spot at send in seconds, a clock ahead of the receiver's counts as 0
+void fresh_age(struct fresh *f, int64_t age) {
+  uint32_t i;
+
+  if(age < 0) age = 0;
+  f->count++;
+  f->sum += age;
+  for(i = 0; i < FRESH_BUCKETS && age > bound[i]; i++);
+  if(i < FRESH_BUCKETS) f->bucket[i]++;
+}
+
+// One stale spot as a decode line, written at once so lines of
+// several uploaders appending to one archive never interleave
+void fresh_archive(struct fresh *f, uint32_t when, double sync, int32_t snr, double dt, int32_t freq,
+    const char *call, const char *grid) {
+  char line[96];
+  time_t t = when;
+  struct tm tm;
+  int size;
+
+  f->stale++;
+  if(f->fd < 0) return;
+
+  gmtime_r(&t, &tm);
+  size = snprintf(line, sizeof(line), "%02d%02d%02d %02d%02d%02d %5.1f %3d %5.2f %8d %s %s\n",
+    tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, sync, snr, dt, freq, call, grid);
+  if(size > 0 && size < (int)sizeof(line) && write(f->fd, line, size) == size) f->archived++;
+}
+
+void fresh_report(const struct fresh *f) {
+  char series[64];
+  uint64_t count = 0;
+  uint32_t i;
+
+  for(i = 0; i < FRESH_BUCKETS; i++) {
+    count += f->bucket[i];
+    snprintf(series, sizeof(series), "rbn_spot_age_seconds_bucket{le=\"%u\"}", bound[i]);
+    metrics_set(series, count);
+  }
+  metrics_set("rbn_spot_age_seconds_bucket{le=\"+Inf\"}", f->count);
+  metrics_set("rbn_spot_age_seconds_sum", f->sum);
+  metrics_set("rbn_spot_age_seconds_count", f->count);
+  metrics_set("rbn_stale_spots_total", f->stale);
+  metrics_set("rbn_archived_spots_total", f->archived);
+}
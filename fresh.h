@@ -0,0 +1,33 @@
+/* Freshness budget for spots at send time.
+   A spot is worth little to RBN once it is minutes old, replayed late
+   it only loads RBN Aggregator. The age of every spot at send time,
+   counted from its decode timestamp, goes into a histogram, and spots
+   older than the budget are not broadcast. They still count in the
+   local statistics and go to the archive file if there is one, as
+   decode lines that can be replayed later.
+   */
+
+#ifndef FRESH_H
+#define FRESH_H
+
+#include <stdint.h>
+
+#define FRESH_BUCKETS 8             // Histogram buckets besides +Inf
+
+struct fresh {
+  int fd;                           // Archive file, -1 if none
+  uint32_t stale;                   // Spots past the budget, not broadcast
+  uint32_t archived;                // Stale spots written to the archive
+  uint64_t count;                   // Spots in the histogram
+  double sum;                       // Their ages in seconds
+  uint32_t bucket[FRESH_BUCKETS];   // Spots up to each bound and above the one before
+};
+
+int fresh_open(struct fresh *f, const char *archive_path);
+void fresh_close(struct fresh *f);
+void fresh_age(struct fresh *f, int64_t age);
+void fresh_archive(struct fresh *f, uint32_t when, double sync, int32_t snr, double dt, int32_t freq,
+  const char *call, const char *grid);
+void fresh_report(const struct fresh *f);
+
+#endif
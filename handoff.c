@@ -0,0 +1,217 @@
+/* Single instance guard, see handoff.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "handoff.h"
+
+static int address(struct sockaddr_un *addr, const char *path) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  return snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path) < (int)sizeof(addr->sun_path) ? 0 : -1;
+}
+
+// Part of the name line, keeps the descriptor that came with it
+static ssize_t receive(int sock, char *data, size_t size, int *file) {
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct iovec iov = { data, size };
+  struct msghdr msg;
+  struct cmsghdr *c;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.space;
+  msg.msg_controllen = sizeof(control.space);
+  if((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0) return n;
+
+  for(c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c))
+    if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS && c->cmsg_len == CMSG_LEN(sizeof(int))) {
+      if(*file >= 0) close(*file);
+      memcpy(file, CMSG_DATA(c), sizeof(int));
+    }
+  return n;
+}
+
+// Read one name line and the descriptor sent with it, acknowledge it
+// with a byte once it is queued
+static void *acceptor(void *arg) {
+  struct handoff *h = arg;
+  char text[HANDOFF_PATH];
+  int fd, file, n, used;
+
+  while((fd = accept4(h->listen, NULL, NULL, SOCK_CLOEXEC)) >= 0 || errno == EINTR || errno == ECONNABORTED) {
+    if(fd < 0) continue;
+
+    file = -1;
+    for(used = 0; used < HANDOFF_PATH - 1 && memchr(text, '\n', used) == NULL
+        && (n = receive(fd, text + used, HANDOFF_PATH - 1 - used, &file)) > 0; used += n);
+    while(used && (text[used - 1] == '\n' || text[used - 1] == '\r')) used--;
+    text[used] = 0;
+
+    pthread_mutex_lock(&h->mutex);
+    if(file >= 0 && !h->closing && h->count < HANDOFF_QUEUE) {
+      h->fd[(h->head + h->count) % HANDOFF_QUEUE] = file;
+      memcpy(h->file[(h->head + h->count++) % HANDOFF_QUEUE], text, used + 1);
+      if(send(fd, "", 1, MSG_NOSIGNAL) == 1) file = -1;
+      else h->count--; // The other uploader gave up, it sends on its own
+    }
+    pthread_mutex_unlock(&h->mutex);
+    if(file >= 0) close(file);
+    close(fd);
+  }
+
+  return NULL; // Listening socket shut down
+}
+
+// Holding the lock, any socket left behind is stale
+static int serve(struct handoff *h) {
+  struct sockaddr_un addr;
+  sigset_t all, old;
+  mode_t mask;
+
+  address(&addr, h->path);
+  unlink(h->path);
+  mask = umask(077); // Only the same user may hand over files
+  h->listen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(h->listen < 0 || bind(h->listen, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(h->listen, HANDOFF_QUEUE) < 0) {
+    umask(mask);
+    fprintf(stderr, "Cannot listen on %s.\n", h->path);
+    return -1;
+  }
+  umask(mask);
+
+  pthread_mutex_init(&h->mutex, NULL);
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  if(pthread_create(&h->thread, NULL, acceptor, h) != 0) {
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    fprintf(stderr, "Cannot start handoff thread.\n");
+    return -1;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return 1;
+}
+
+// Pass the open file to the running uploader with its name for
+// messages, 0 once it acknowledged
+static int hand_over(struct handoff *h, int file, const char *name) {
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct sockaddr_un addr;
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *c;
+  char text[HANDOFF_PATH], ack;
+  int fd, size, rc = -1;
+
+  size = snprintf(text, sizeof(text), "%.*s\n", HANDOFF_PATH - 2, name);
+  iov.iov_base = text;
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.space;
+  msg.msg_controllen = sizeof(control.space);
+  c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(c), &file, sizeof(int));
+
+  address(&addr, h->path);
+  if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+  if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && sendmsg(fd, &msg, MSG_NOSIGNAL) == size
+      && shutdown(fd, SHUT_WR) == 0 && read(fd, &ack, 1) == 1)
+    rc = 0;
+  close(fd);
+  return rc;
+}
+
+/* 1 with the lock held and file to be sent by the caller, 0 once the
+   open file fd was handed to the uploader holding the lock, -1 on
+   failure. Without an uploader to take the file, waits for the lock. */
+int handoff_open(struct handoff *h, const char *lock_path, int fd, const char *file) {
+  struct sockaddr_un addr;
+
+  h->listen = -1;
+  h->closing = 0;
+  h->head = h->count = 0;
+  if(snprintf(h->path, sizeof(h->path), "%s.sock", lock_path) >= (int)sizeof(h->path) || address(&addr, h->path) < 0) {
+    fprintf(stderr, "Lock file path %s is too long.\n", lock_path);
+    return -1;
+  }
+
+  if((h->lock = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+    fprintf(stderr, "Cannot open lock file %s.\n", lock_path);
+    return -1;
+  }
+
+  if(flock(h->lock, LOCK_EX | LOCK_NB) == 0) return serve(h);
+  if(errno == EWOULDBLOCK && hand_over(h, fd, file) == 0) {
+    close(h->lock);
+    return 0;
+  }
+
+  // The running uploader is starting, closing or full, send after it
+  if(flock(h->lock, LOCK_EX) < 0) {
+    fprintf(stderr, "Cannot lock %s.\n", lock_path);
+    return -1;
+  }
+  return serve(h);
+}
+
+// Descriptor of the next handed over file, its name copied into file,
+// -1 once there are none left. From then on nothing is acknowledged,
+// later uploaders wait for the lock.
+int handoff_next(struct handoff *h, char *file) {
+  int rc = -1;
+
+  if(h->listen < 0) return -1;
+
+  pthread_mutex_lock(&h->mutex);
+  if(h->count) {
+    rc = h->fd[h->head];
+    memcpy(file, h->file[h->head], HANDOFF_PATH);
+    h->head = (h->head + 1) % HANDOFF_QUEUE;
+    h->count--;
+  }
+  else h->closing = 1;
+  pthread_mutex_unlock(&h->mutex);
+  if(rc >= 0) return rc;
+
+  unlink(h->path);
+  shutdown(h->listen, SHUT_RDWR); // Wakes the acceptor
+  pthread_join(h->thread, NULL);
+  close(h->listen);
+  h->listen = -1;
+  return -1;
+}
+
+// Drop the lock, a waiting uploader starts on its own
+void handoff_close(struct handoff *h) {
+  char file[HANDOFF_PATH];
+  int fd;
+
+  while((fd = handoff_next(h, file)) >= 0) {
+    fprintf(stderr, "Handed over file %s was not sent.\n", file);
+    close(fd);
+  }
+  close(h->lock);
+}
@@ -0,0 +1,40 @@
+/* Single instance guard for the once per file mode.
+   The first uploader to take an flock on the lock file sends, later
+   ones started while it runs (an overlapping cron job) pass their open
+   decode file to it with SCM_RIGHTS over a Unix socket next to the
+   lock file and exit. Passing the descriptor rather than the path
+   keeps the file the later run was started for, even if a newer
+   decode file has taken its name by the time it is read. A thread of
+   the running uploader queues the descriptors and acknowledges each,
+   and the uploader sends the queued files after its own, so only one
+   process ever paces datagrams towards RBN Aggregator. An uploader
+   whose file is not acknowledged, because the queue is full or the
+   running one is closing, waits for the lock and sends it itself.
+   */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define HANDOFF_QUEUE 64          // Files waiting to be sent by the running uploader
+#define HANDOFF_PATH 512          // Longest file name kept for messages
+
+struct handoff {
+  int lock;                       // Locked lock file
+  int listen;                     // Socket for handed over files, -1 once closed
+  char path[108];                 // Socket path, the lock file with .sock appended
+  pthread_t thread;               // Accepts and acknowledges handed over files
+  pthread_mutex_t mutex;
+  int32_t closing;                // No more acknowledgements, set under mutex
+  uint32_t head, count;           // Queue of handed over files
+  int fd[HANDOFF_QUEUE];
+  char file[HANDOFF_QUEUE][HANDOFF_PATH];
+};
+
+int handoff_open(struct handoff *h, const char *lock_path, int fd, const char *file);
+int handoff_next(struct handoff *h, char *file);
+void handoff_close(struct handoff *h);
+
+#endif
@@ -0,0 +1,345 @@
+/* Persistent first-heard call set, see heard.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "heard.h"
+#include "intern.h"
+
+#define HEARD_MAGIC 0x52424e46 // "RBNF"
+#define HEARD_VERSION 1
+#define HEARD_BLOCK 512        // Keys read or written at once, a 4 kB page
+
+struct heard_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t pad;
+};
+
+// Base frequency in kHz in the top 16 bits, call hash below, never zero
+static uint64_t make_key(int32_t base, const char *call) {
+  return (uint64_t)(base / 1000 & 0xffff) << 48 | (intern_hash64(call) & 0xffffffffffffull);
+}
+
+static int map(struct heard *h, const char *path) {
+  const struct heard_header *header;
+  struct stat st;
+  void *p;
+  int fd;
+
+  if((fd = open(path, O_RDONLY)) < 0) return 0;
+
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header)
+      || (p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    fprintf(stderr, "Cannot map heard file %s.\n", path);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  header = p;
+  if(header->magic != HEARD_MAGIC || header->version != HEARD_VERSION
+      || sizeof(*header) + (size_t)header->count * sizeof(uint64_t) > (size_t)st.st_size) {
+    fprintf(stderr, "%s is not a heard file.\n", path);
+    munmap(p, st.st_size);
+    return -1;
+  }
+
+  h->length = st.st_size;
+  h->dev = st.st_dev;
+  h->ino = st.st_ino;
+  h->key = (const uint64_t *)(header + 1);
+  h->count = header->count;
+  madvise(p, h->length, MADV_RANDOM);
+  return 0;
+}
+
+// Copy n file keys from index first, n if all were read
+static uint32_t keys_at(const struct heard *h, uint32_t first, uint64_t *out, uint32_t n) {
+  size_t size = (size_t)n * sizeof(*out);
+
+  if(h->key != NULL) {
+    memcpy(out, h->key + first, size);
+    return n;
+  }
+  return pread(h->fd, out, size, sizeof(struct heard_header) + (off_t)first * sizeof(*out)) == (ssize_t)size ? n : 0;
+}
+
+// Under a limit the file stays on disk: keep every stride-th key in
+// memory and read the block between two of them when looking up
+static int fence(struct heard *h, const char *path) {
+  struct heard_header header;
+  uint64_t block[HEARD_BLOCK];
+  struct stat st;
+  uint32_t i, n;
+
+  if((h->fd = open(path, O_RDONLY)) < 0) return 0;
+
+  if(fstat(h->fd, &st) < 0 || pread(h->fd, &header, sizeof(header), 0) != sizeof(header)
+      || header.magic != HEARD_MAGIC || header.version != HEARD_VERSION
+      || sizeof(header) + (size_t)header.count * sizeof(uint64_t) > (size_t)st.st_size) {
+    fprintf(stderr, "%s is not a heard file.\n", path);
+    return -1;
+  }
+
+  h->count = header.count;
+  h->dev = st.st_dev;
+  h->ino = st.st_ino;
+  for(h->stride = HEARD_BLOCK; h->count / h->stride >= h->fence_size; h->stride *= 2);
+  for(i = 0, h->fences = 0; i < h->count; i += n) {
+    n = h->count - i < HEARD_BLOCK ? h->count - i : HEARD_BLOCK;
+    if(keys_at(h, i, block, n) != n) {
+      fprintf(stderr, "Cannot read heard file %s.\n", path);
+      return -1;
+    }
+    if(i % h->stride == 0) h->fence[h->fences++] = block[0];
+  }
+
+  return 0;
+}
+
+static int load(struct heard *h, const char *path) {
+  return h->limit ? fence(h, path) : map(h, path);
+}
+
+static void unmap(struct heard *h) {
+  if(h->length) munmap((void *)((const struct heard_header *)h->key - 1), h->length);
+  if(h->fd >= 0) close(h->fd);
+  h->key = NULL;
+  h->fd = -1;
+  h->count = 0;
+  h->fences = 0;
+  h->length = 0;
+  h->dev = h->ino = 0;
+}
+
+// Missing file is an empty set. Under a limit the delta never grows
+// beyond limit slots and the file is read instead of mapped.
+int heard_open(struct heard *h, const char *path, uint32_t capacity, uint32_t limit) {
+  memset(h, 0, sizeof(*h));
+  h->fd = -1;
+  h->limit = limit;
+  h->fence_size = 2 * limit; // As many bytes as the delta
+  h->delta_mask = 255;
+  while(h->delta_mask + 1 < 2 * capacity) h->delta_mask = 2 * h->delta_mask + 1;
+  h->delta = calloc(h->delta_mask + 1, sizeof(*h->delta));
+  h->sorted = malloc((h->delta_mask + 1) * sizeof(*h->sorted));
+  if(limit) h->fence = malloc(h->fence_size * sizeof(*h->fence));
+  if(h->delta == NULL || h->sorted == NULL || (limit && h->fence == NULL) || load(h, path) < 0) {
+    heard_close(h);
+    return -1;
+  }
+
+  return 0;
+}
+
+void heard_close(struct heard *h) {
+  unmap(h);
+  free(h->delta);
+  free(h->sorted);
+  free(h->fence);
+  memset(h, 0, sizeof(*h));
+  h->fd = -1;
+}
+
+static int find(const uint64_t *key, uint32_t count, uint64_t k) {
+  uint32_t low = 0, high = count, mid;
+
+  while(low < high) {
+    mid = low + (high - low) / 2;
+    if(key[mid] < k) low = mid + 1;
+    else high = mid;
+  }
+  return low < count && key[low] == k;
+}
+
+// Membership in the file, mapped or through the fences
+static int contains(const struct heard *h, uint64_t k) {
+  uint64_t block[HEARD_BLOCK], key;
+  uint32_t low = 0, high = h->fences, mid, first, end;
+
+  if(h->fd < 0) return find(h->key, h->count, k);
+
+  // Block whose fence is the last one not above k
+  while(low < high) {
+    mid = low + (high - low) / 2;
+    if(h->fence[mid] <= k) low = mid + 1;
+    else high = mid;
+  }
+  if(!low) return 0;
+  first = (low - 1) * h->stride;
+  end = first + h->stride < h->count ? first + h->stride : h->count;
+
+  // Narrow a large block down key by key, then read what is left at once
+  while(end - first > HEARD_BLOCK) {
+    mid = first + (end - first) / 2;
+    if(keys_at(h, mid, &key, 1) != 1) return 0;
+    if(key <= k) first = mid;
+    else end = mid;
+  }
+  return keys_at(h, first, block, end - first) == end - first && find(block, end - first, k);
+}
+
+static int grow(struct heard *h) {
+  uint32_t i, j, mask = 2 * h->delta_mask + 1;
+  uint64_t *delta, *sorted;
+
+  if(h->limit && mask + 1 > h->limit) return -1;
+  if((sorted = realloc(h->sorted, (mask + 1) * sizeof(*sorted))) == NULL) return -1;
+  h->sorted = sorted;
+  if((delta = calloc(mask + 1, sizeof(*delta))) == NULL) return -1;
+  for(i = 0; i <= h->delta_mask; i++) {
+    if(!h->delta[i]) continue;
+    for(j = h->delta[i] & mask; delta[j]; j = (j + 1) & mask);
+    delta[j] = h->delta[i];
+  }
+  free(h->delta);
+  h->delta = delta;
+  h->delta_mask = mask;
+  return 0;
+}
+
+// Return 1 and remember the call if it was never heard on this band before
+int heard_first(struct heard *h, int32_t base, const char *call) {
+  uint64_t k = make_key(base, call);
+  uint32_t i;
+
+  if(contains(h, k)) return 0;
+
+  for(i = k & h->delta_mask; h->delta[i]; i = (i + 1) & h->delta_mask)
+    if(h->delta[i] == k) return 0;
+
+  // Grow at half load, a failed grow only costs probe length
+  if(2 * (h->delta_count + 1) > h->delta_mask + 1 && grow(h) == 0)
+    for(i = k & h->delta_mask; h->delta[i]; i = (i + 1) & h->delta_mask);
+  if(h->delta_count + 1 < h->delta_mask + 1) {
+    h->delta[i] = k;
+    h->delta_count++;
+  }
+
+  return 1;
+}
+
+// Heapsort, glibc qsort() may allocate a merge buffer
+static void sort_keys(uint64_t *key, uint32_t n) {
+  uint32_t start = n / 2, end = n, root, child;
+  uint64_t k;
+
+  while(end > 1) {
+    if(start > 0) start--;
+    else {
+      k = key[--end];
+      key[end] = key[0];
+      key[0] = k;
+    }
+    for(root = start; (child = 2 * root + 1) < end; root = child) {
+      if(child + 1 < end && key[child] < key[child + 1]) child++;
+      if(key[root] >= key[child]) break;
+      k = key[root];
+      key[root] = key[child];
+      key[child] = k;
+    }
+  }
+}
+
+// Lock on path.lock, held while the file is merged and replaced. The
+// file itself cannot carry it, every save renames a new one in place.
+static int lock_file(const char *path) {
+  char name[4096];
+  int fd;
+
+  snprintf(name, sizeof(name), "%s.lock", path);
+  if((fd = open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) return -1;
+  if(flock(fd, LOCK_EX) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Merge the delta into a new file, then map the new file
+int heard_save(struct heard *h, const char *path) {
+  struct heard_header header = { HEARD_MAGIC, HEARD_VERSION, 0, 0 };
+  uint64_t *sorted = h->sorted, in[HEARD_BLOCK], out[HEARD_BLOCK];
+  uint32_t i, j, k, n = 0, got = 0, pos = 0;
+  char tmp[4096];
+  struct stat st;
+  int fd = -1, lock, rc = 0;
+
+  if(!h->delta_count) return 0;
+
+  // Another uploader saved since the file was loaded, merge into its file
+  if((lock = lock_file(path)) < 0) goto fail;
+  if(stat(path, &st) == 0 && ((uint64_t)st.st_dev != h->dev || (uint64_t)st.st_ino != h->ino)) {
+    unmap(h);
+    if(load(h, path) < 0) goto fail;
+  }
+
+  // Sort a copy so the delta stays intact if writing fails
+  for(i = 0; i <= h->delta_mask; i++)
+    if(h->delta[i]) sorted[n++] = h->delta[i];
+  sort_keys(sorted, n);
+
+  // Plain write() in chunks, a resident uploader saves often and stdio would allocate
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  if((fd = mkostemp(tmp, O_CLOEXEC)) < 0) goto fail;
+  if(fchmod(fd, 0644) < 0 || write(fd, &header, sizeof(header)) != sizeof(header)) rc = -1;
+  for(i = 0, j = 0; rc == 0 && (i < h->count || j < n);) {
+    for(k = 0; k < HEARD_BLOCK && (i < h->count || j < n); k++) {
+      // Old keys come a block at a time, the file need not be mapped
+      if(pos == got && i < h->count) {
+        pos = 0;
+        got = h->count - i < HEARD_BLOCK ? h->count - i : HEARD_BLOCK;
+        if(keys_at(h, i, in, got) != got) {
+          rc = -1;
+          break;
+        }
+      }
+      if(j == n || (i < h->count && in[pos] < sorted[j])) {
+        out[k] = in[pos++];
+        i++;
+      }
+      else {
+        if(i < h->count && in[pos] == sorted[j]) { // The other uploader heard it too
+          pos++;
+          i++;
+        }
+        out[k] = sorted[j++];
+      }
+    }
+    header.count += k;
+    if(write(fd, out, k * sizeof(*out)) != (ssize_t)(k * sizeof(*out))) rc = -1;
+  }
+  if(rc == 0 && pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) rc = -1;
+  if(close(fd) != 0 || rc < 0 || rename(tmp, path) != 0) goto fail;
+
+  unmap(h);
+  memset(h->delta, 0, (h->delta_mask + 1) * sizeof(*h->delta));
+  h->delta_count = 0;
+  rc = load(h, path);
+  close(lock);
+  return rc;
+
+fail:
+  if(fd >= 0) unlink(tmp);
+  if(lock >= 0) close(lock);
+  fprintf(stderr, "Cannot write heard file %s.\n", path);
+  return -1;
+}
+
+// 1 once the delta is at half load and may not grow
+int heard_full(const struct heard *h) {
+  return h->limit && 2 * (h->delta_count + 1) > h->delta_mask + 1 && 2 * (h->delta_mask + 1) > h->limit;
+}
+
+size_t heard_memory(const struct heard *h) {
+  return (size_t)(h->delta_mask + 1) * (sizeof(*h->delta) + sizeof(*h->sorted))
+    + (size_t)h->fence_size * sizeof(*h->fence);
+}
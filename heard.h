@@ -0,0 +1,46 @@
+/* Persistent set of every (band, call) ever heard.
+   The file is a sorted array of 64-bit keys mapped read only at
+   startup, membership is a binary search. Calls heard for the first
+   time go to a small in-memory delta set, heard_save() merges the
+   delta into a new sorted file and renames it over the old one. The
+   delta keeps its memory across saves, sized for capacity new calls.
+   Under a limit the delta stops growing and heard_full() tells the
+   owner to save early, and the file is read on lookup through an
+   in-memory index of every few hundredth key instead of being mapped,
+   so its pages never count against the process. Saves take a lock on
+   a .lock file next to the set file. Under it a file another uploader
+   saved in the meantime is loaded again, so the delta is merged into
+   the newest file and no uploader's calls get lost.
+   */
+
+#ifndef HEARD_H
+#define HEARD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct heard {
+  const uint64_t *key;    // Sorted keys from the file
+  uint32_t count;
+  size_t length;          // Mapped bytes, 0 if nothing mapped
+  int32_t fd;             // File read through the fences under a limit, -1 if not
+  uint64_t dev, ino;      // Identity of the loaded file, 0 if there was none
+  uint64_t *fence;        // Every stride-th file key, under a limit
+  uint32_t fences;
+  uint32_t fence_size;
+  uint32_t stride;
+  uint64_t *delta;        // Open addressing set of new keys, 0 = empty
+  uint32_t delta_count;
+  uint32_t delta_mask;
+  uint32_t limit;         // Delta slots the set may grow to, 0 for no limit
+  uint64_t *sorted;       // Scratch for heard_save(), as large as delta
+};
+
+int heard_open(struct heard *h, const char *path, uint32_t capacity, uint32_t limit);
+void heard_close(struct heard *h);
+int heard_first(struct heard *h, int32_t base, const char *call);
+int heard_save(struct heard *h, const char *path);
+int heard_full(const struct heard *h);
+size_t heard_memory(const struct heard *h);
+
+#endif
@@ -0,0 +1,217 @@
+/* HyperLogLog sketches of distinct calls, see hll.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "hll.h"
+
+#define HLL_MAGIC 0x52424e48 // "RBNH"
+#define HLL_VERSION 1
+
+struct hll_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t p;
+  uint32_t count;
+};
+
+void hll_init(struct hll_set *s) {
+  memset(s, 0, sizeof(*s));
+}
+
+void hll_free(struct hll_set *s) {
+  free(s->record);
+  memset(s, 0, sizeof(*s));
+}
+
+// Union the sketches of days from oldest on into s, plain read() so a
+// resident uploader merging on every save does not allocate. Missing
+// file is not an error.
+static int read_file(struct hll_set *s, const char *path, uint32_t oldest) {
+  struct hll_header h;
+  struct hll_record r;
+  uint32_t i;
+  int fd, rc = 0;
+
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+
+  if(read(fd, &h, sizeof(h)) != sizeof(h) || h.magic != HLL_MAGIC
+      || h.version != HLL_VERSION || h.p != HLL_P) {
+    fprintf(stderr, "%s is not a call count file.\n", path);
+    rc = -1;
+  }
+
+  for(i = 0; rc == 0 && i < h.count; i++) {
+    if(read(fd, &r, sizeof(r)) != sizeof(r)) {
+      fprintf(stderr, "%s is truncated.\n", path);
+      rc = -1;
+    }
+    else if(r.day >= oldest) hll_union(hll_get(s, r.day, r.base), &r);
+  }
+
+  close(fd);
+  return rc;
+}
+
+int hll_load(struct hll_set *s, const char *path) {
+  return read_file(s, path, 0);
+}
+
+// Lock on path.lock, held while the file is read and replaced. The
+// file itself cannot carry it, every save renames a new one in place.
+static int lock_file(const char *path) {
+  char name[4096];
+  int fd;
+
+  snprintf(name, sizeof(name), "%s.lock", path);
+  if((fd = open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) return -1;
+  if(flock(fd, LOCK_EX) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Write to a temporary file of our own, then rename it in place.
+// Plain write(), a resident uploader saves often and stdio would allocate.
+static int write_file(const struct hll_set *s, const char *path) {
+  struct hll_header h = { HLL_MAGIC, HLL_VERSION, HLL_P, s->count };
+  size_t size = (size_t)s->count * sizeof(*s->record);
+  char tmp[4096];
+  int fd, rc;
+
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  if((fd = mkostemp(tmp, O_CLOEXEC)) < 0) return -1;
+  rc = fchmod(fd, 0644) == 0 && write(fd, &h, sizeof(h)) == sizeof(h)
+    && write(fd, s->record, size) == (ssize_t)size ? 0 : -1;
+  if(close(fd) != 0) rc = -1;
+  if(rc < 0 || rename(tmp, path) != 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+// Replace the file with s
+int hll_save(const struct hll_set *s, const char *path) {
+  int lock = lock_file(path), rc = lock < 0 ? -1 : write_file(s, path);
+
+  if(rc < 0) fprintf(stderr, "Cannot write call count file %s.\n", path);
+  if(lock >= 0) close(lock);
+  return rc;
+}
+
+/* Merge s with the file and save the result, for uploaders that share
+   the file. Under the lock whatever another uploader saved since s was
+   loaded is merged in first, sketches of days before oldest are
+   dropped. Merging is lossless, so no uploader's calls get lost. */
+int hll_update(struct hll_set *s, const char *path, uint32_t oldest) {
+  int lock = lock_file(path), rc = -1;
+
+  if(lock >= 0 && read_file(s, path, oldest) == 0) {
+    hll_prune(s, oldest);
+    rc = write_file(s, path);
+  }
+  if(rc < 0) fprintf(stderr, "Cannot update call count file %s.\n", path);
+  if(lock >= 0) close(lock);
+  return rc;
+}
+
+// Room for count sketches, so hll_get() need not grow the set later
+int hll_reserve(struct hll_set *s, uint32_t count) {
+  struct hll_record *r;
+
+  if(s->size >= count) return 0;
+  if((r = realloc(s->record, count * sizeof(*r))) == NULL) return -1;
+  s->record = r;
+  s->size = count;
+  return 0;
+}
+
+// Find or create the sketch for a band and day, NULL if out of memory.
+// At the limit the sketch of the oldest day makes room, NULL if the
+// day asked for is older still.
+struct hll_record *hll_get(struct hll_set *s, uint32_t day, int32_t base) {
+  struct hll_record *r, *oldest = NULL;
+  uint32_t i, size;
+
+  for(i = 0; i < s->count; i++) {
+    if(s->record[i].day == day && s->record[i].base == base) return &s->record[i];
+    if(oldest == NULL || s->record[i].day < oldest->day) oldest = &s->record[i];
+  }
+
+  if(s->limit && s->count >= s->limit) {
+    if(oldest == NULL || oldest->day > day) return NULL;
+    s->evicted++;
+    r = oldest;
+  }
+  else if(s->count == s->size) {
+    size = s->limit && s->size + 16 > s->limit ? s->limit : s->size + 16;
+    if((r = realloc(s->record, size * sizeof(*r))) == NULL) return NULL;
+    s->record = r;
+    s->size = size;
+    r = &s->record[s->count++];
+  }
+  else r = &s->record[s->count++];
+
+  memset(r, 0, sizeof(*r));
+  r->day = day;
+  r->base = base;
+  return r;
+}
+
+// h is intern_hash64() of the call
+void hll_add(struct hll_record *r, uint64_t h) {
+  uint32_t i = h >> (64 - HLL_P);
+  uint8_t rank = __builtin_clzll((h << HLL_P) | (1ull << (HLL_P - 1))) + 1;
+
+  if(rank > r->reg[i]) r->reg[i] = rank;
+}
+
+void hll_union(struct hll_record *r, const struct hll_record *other) {
+  uint32_t i;
+
+  if(r == NULL) return;
+  for(i = 0; i < HLL_REGISTERS; i++)
+    if(other->reg[i] > r->reg[i]) r->reg[i] = other->reg[i];
+}
+
+int hll_merge(struct hll_set *s, const struct hll_set *other) {
+  struct hll_record *r;
+  uint32_t i;
+
+  for(i = 0; i < other->count; i++) {
+    if((r = hll_get(s, other->record[i].day, other->record[i].base)) == NULL) return -1;
+    hll_union(r, &other->record[i]);
+  }
+  return 0;
+}
+
+// Drop sketches of days before oldest
+void hll_prune(struct hll_set *s, uint32_t oldest) {
+  uint32_t i, n = 0;
+
+  for(i = 0; i < s->count; i++)
+    if(s->record[i].day >= oldest) s->record[n++] = s->record[i];
+  s->count = n;
+}
+
+double hll_estimate(const struct hll_record *r) {
+  double m = HLL_REGISTERS, sum = 0, e;
+  uint32_t i, zero = 0;
+
+  for(i = 0; i < HLL_REGISTERS; i++) {
+    sum += ldexp(1.0, -r->reg[i]);
+    zero += !r->reg[i];
+  }
+
+  e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  if(e <= 2.5 * m && zero) e = m * log(m / zero); // Linear counting for small sets
+  return e;
+}
@@ -0,0 +1,47 @@
+/* HyperLogLog sketches of distinct calls per band and UTC day.
+   A sketch is 1 kB (1024 registers, about 3 % standard error) and two
+   sketches merge by taking the larger register, so state files from
+   several receivers or several days combine losslessly. Sketches are
+   keyed by base frequency rather than band index so that receivers
+   with different band plans can be merged. Saves take a lock on a
+   .lock file next to the state file and write a temporary file of
+   their own, and uploaders sharing the file merge it in on every save.
+   */
+
+#ifndef HLL_H
+#define HLL_H
+
+#include <stdint.h>
+
+#define HLL_P 10
+#define HLL_REGISTERS (1 << HLL_P)
+#define HLL_DAYS 8        // Days kept in the uploader's state file
+
+struct hll_record {
+  uint32_t day;           // Days since the epoch, UTC
+  int32_t base;           // Base frequency in Hz
+  uint8_t reg[HLL_REGISTERS];
+};
+
+struct hll_set {
+  uint32_t count;
+  uint32_t size;
+  uint32_t limit;         // Sketches the set may grow to, 0 for no limit
+  uint32_t evicted;       // Sketches of old days replaced at the limit
+  struct hll_record *record;
+};
+
+void hll_init(struct hll_set *s);
+void hll_free(struct hll_set *s);
+int hll_load(struct hll_set *s, const char *path);
+int hll_save(const struct hll_set *s, const char *path);
+int hll_update(struct hll_set *s, const char *path, uint32_t oldest);
+int hll_reserve(struct hll_set *s, uint32_t count);
+struct hll_record *hll_get(struct hll_set *s, uint32_t day, int32_t base);
+void hll_add(struct hll_record *r, uint64_t h);
+int hll_merge(struct hll_set *s, const struct hll_set *other);
+void hll_union(struct hll_record *r, const struct hll_record *other);
+void hll_prune(struct hll_set *s, uint32_t oldest);
+double hll_estimate(const struct hll_record *r);
+
+#endif
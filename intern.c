@@ -0,0 +1,162 @@
+/* Call sign interning table, see intern.h */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+
+int intern_init(struct intern *t, uint32_t capacity) {
+  uint32_t slots = 64;
+
+  while(slots < 2 * capacity) slots <<= 1; // Keep load factor below 0.5
+
+  memset(t, 0, sizeof(*t));
+  t->ids_size = slots / 2;
+  t->arena_size = t->ids_size * 8; // Typical call sign plus terminator
+  t->mask = slots - 1;
+  t->arena = malloc(t->arena_size);
+  t->offset = malloc(t->ids_size * sizeof(*t->offset));
+  t->hash = malloc(t->ids_size * sizeof(*t->hash));
+  t->slots = calloc(slots, sizeof(*t->slots));
+
+  if(t->arena == NULL || t->offset == NULL || t->hash == NULL || t->slots == NULL) {
+    intern_free(t);
+    return -1;
+  }
+
+  return 0;
+}
+
+void intern_free(struct intern *t) {
+  free(t->arena);
+  free(t->offset);
+  free(t->hash);
+  free(t->slots);
+  memset(t, 0, sizeof(*t));
+}
+
+// Forget every call but keep the memory for the next ones
+void intern_clear(struct intern *t) {
+  memset(t->slots, 0, (t->mask + 1) * sizeof(*t->slots));
+  t->count = 0;
+  t->arena_used = 0;
+}
+
+static int grow_slots(struct intern *t) {
+  uint32_t i, j, mask = 2 * t->mask + 1;
+  uint64_t *slots;
+
+  if((slots = calloc(mask + 1, sizeof(*slots))) == NULL) return -1;
+
+  for(i = 0; i <= t->mask; i++) {
+    if(!t->slots[i]) continue;
+    j = (t->slots[i] >> 32) & mask;
+    while(slots[j]) j = (j + 1) & mask;
+    slots[j] = t->slots[i];
+  }
+
+  free(t->slots);
+  t->slots = slots;
+  t->mask = mask;
+  return 0;
+}
+
+// Look up the slot holding call, or the empty slot where it belongs
+static uint32_t probe(const struct intern *t, const char *call, uint32_t hash) {
+  uint32_t i = hash & t->mask;
+  uint64_t slot;
+
+  while((slot = t->slots[i])) {
+    if((uint32_t)(slot >> 32) == hash
+        && strcmp(t->arena + t->offset[(uint32_t)slot - 1], call) == 0)
+      break;
+    i = (i + 1) & t->mask;
+  }
+
+  return i;
+}
+
+uint32_t intern_find(const struct intern *t, const char *call) {
+  uint32_t hash = intern_hash64(call) >> 32;
+  uint64_t slot = t->slots[probe(t, call, hash)];
+
+  return slot ? (uint32_t)slot - 1 : INTERN_NONE;
+}
+
+// The index keys on the high word of the 64-bit hash, the id keeps all of it
+uint32_t intern_call(struct intern *t, const char *call) {
+  uint64_t full = intern_hash64(call), *hashes;
+  uint32_t i, id, size, length, hash = full >> 32;
+  uint32_t *offset;
+  char *arena;
+
+  i = probe(t, call, hash);
+  if(t->slots[i]) return (uint32_t)t->slots[i] - 1;
+
+  if(t->count == INTERN_NONE - 1 || (t->limit && t->count == t->limit)) return INTERN_NONE;
+
+  // Keep load factor below 0.5, a failed grow is fine while a slot stays free
+  if(2 * (t->count + 1) > t->mask + 1) {
+    if(grow_slots(t) == 0) i = probe(t, call, hash);
+    else if(t->count + 2 > t->mask + 1) return INTERN_NONE;
+  }
+
+  if(t->count == t->ids_size) {
+    size = t->limit && 2 * t->ids_size > t->limit ? t->limit : 2 * t->ids_size;
+    if((offset = realloc(t->offset, size * sizeof(*offset))) == NULL) return INTERN_NONE;
+    t->offset = offset;
+    if((hashes = realloc(t->hash, size * sizeof(*hashes))) == NULL) return INTERN_NONE;
+    t->hash = hashes;
+    t->ids_size = size;
+  }
+
+  length = strlen(call);
+  if(t->arena_used + length + 1 > t->arena_size) {
+    size = 2 * t->arena_size;
+    while(t->arena_used + length + 1 > size) size *= 2;
+    // Under a limit no name is longer than the 13 characters of a spot's call
+    if(t->limit && size > t->limit * 14 && t->arena_used + length + 1 <= t->limit * 14) size = t->limit * 14;
+    if((arena = realloc(t->arena, size)) == NULL) return INTERN_NONE;
+    t->arena = arena;
+    t->arena_size = size;
+  }
+
+  id = t->count++;
+  t->offset[id] = t->arena_used;
+  t->hash[id] = full;
+  memcpy(t->arena + t->arena_used, call, length + 1);
+  t->arena_used += length + 1;
+  t->slots[i] = (uint64_t)hash << 32 | (id + 1);
+
+  return id;
+}
+
+// FNV-1a followed by the MurmurHash3 finalizer to spread the high bits
+uint64_t intern_hash64(const char *call) {
+  uint64_t h = 14695981039346656037ull;
+
+  for(; *call; call++) {
+    h ^= (uint8_t)*call;
+    h *= 1099511628211ull;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+const char *intern_name(const struct intern *t, uint32_t id) {
+  return id < t->count ? t->arena + t->offset[id] : NULL;
+}
+
+uint64_t intern_id_hash(const struct intern *t, uint32_t id) {
+  return id < t->count ? t->hash[id] : 0;
+}
+
+size_t intern_memory(const struct intern *t) {
+  return t->arena_size
+    + (size_t)t->ids_size * (sizeof(*t->offset) + sizeof(*t->hash))
+    + (size_t)(t->mask + 1) * sizeof(*t->slots);
+}
@@ -0,0 +1,43 @@
+/* Call sign interning table.
+   Maps each call sign to a compact 32-bit id so that later
+   stages compare and store integers instead of strings.
+   Strings live in a single growing arena, the index is an
+   open-addressing table of (hash, id) pairs. The 64-bit hash of
+   each call is kept by id, so stages that count or deduplicate
+   calls never hash the string again. Ids only last until the
+   next intern_clear(), the hash is the same in every run.
+   */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define INTERN_NONE 0xffffffffu // Returned when a call cannot be interned
+#define INTERN_CALL_BYTES 64    // Most a call costs under a limit: slots, offsets, hashes and names
+
+struct intern {
+  char *arena;         // NUL terminated call signs, back to back
+  uint32_t arena_size; // Allocated bytes in arena
+  uint32_t arena_used; // Used bytes in arena
+  uint32_t *offset;    // Arena offset of each id
+  uint64_t *hash;      // intern_hash64() of each id's call
+  uint32_t count;      // Number of ids handed out
+  uint32_t ids_size;   // Allocated entries in offset
+  uint64_t *slots;     // Hash in high word, id + 1 in low word, 0 = empty
+  uint32_t mask;       // Number of slots - 1
+  uint32_t limit;      // Ids the table may grow to, 0 for no limit
+};
+
+int intern_init(struct intern *t, uint32_t capacity);
+void intern_free(struct intern *t);
+void intern_clear(struct intern *t);
+uint32_t intern_call(struct intern *t, const char *call);
+uint32_t intern_find(const struct intern *t, const char *call);
+const char *intern_name(const struct intern *t, uint32_t id);
+uint64_t intern_id_hash(const struct intern *t, uint32_t id);
+size_t intern_memory(const struct intern *t);
+uint64_t intern_hash64(const char *call);
+
+#endif
@@ -0,0 +1,51 @@
+/* Allocation counter for ALLOC_COUNT builds.
+   Replaces malloc, calloc and realloc of the whole process with
+   counting wrappers around glibc's own, and alloc_count() of alloc.c
+   with the count. Linked into programs only, never into the library,
+   so an embedding decoder keeps its allocator. Empty without
+   ALLOC_COUNT.
+   */
+
+#ifdef ALLOC_COUNT
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "alloc.h"
+
+// glibc keeps the real allocator under __libc_ names
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static _Atomic uint64_t allocations;
+
+// Exported despite -fvisibility=hidden, so calls from inside libc come here too
+#pragma GCC visibility push(default)
+
+void *malloc(size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+
+#pragma GCC visibility pop
+
+uint64_t alloc_count(void) {
+  return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+
+#else
+
+typedef int interpose_unused; // ISO C wants something in a translation unit
+
+#endif
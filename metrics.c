@@ -0,0 +1,90 @@
+/* Metrics export, see metrics.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+static struct metrics process = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static __thread struct metrics *current;  // NULL for the process wide series
+static pthread_mutex_t text_lock = PTHREAD_MUTEX_INITIALIZER; // Guards the write buffer
+
+void metrics_init(struct metrics *m) {
+  m->count = 0;
+  pthread_mutex_init(&m->lock, NULL);
+}
+
+void metrics_destroy(struct metrics *m) {
+  if(current == m) current = NULL;
+  pthread_mutex_destroy(&m->lock);
+}
+
+// Series this thread sets and writes from now on, NULL for the process wide ones
+void metrics_use(struct metrics *m) {
+  current = m;
+}
+
+static struct metrics_series *find(struct metrics *m, const char *name) {
+  int i;
+
+  for(i = 0; i < m->count; i++)
+    if(strcmp(m->series[i].name, name) == 0) return &m->series[i];
+
+  if(m->count == METRICS_MAX || strlen(name) >= sizeof(m->series[0].name)) return NULL;
+  strcpy(m->series[m->count].name, name);
+  m->series[m->count].value = 0;
+  return &m->series[m->count++];
+}
+
+void metrics_set(const char *name, double value) {
+  struct metrics *m = current != NULL ? current : &process;
+  struct metrics_series *s;
+
+  pthread_mutex_lock(&m->lock);
+  if((s = find(m, name)) != NULL) s->value = value;
+  pthread_mutex_unlock(&m->lock);
+}
+
+void metrics_add(const char *name, double value) {
+  struct metrics *m = current != NULL ? current : &process;
+  struct metrics_series *s;
+
+  pthread_mutex_lock(&m->lock);
+  if((s = find(m, name)) != NULL) s->value += value;
+  pthread_mutex_unlock(&m->lock);
+}
+
+// Write to a temporary file and rename so readers never see a partial file.
+// The text goes through a static buffer, stdio would allocate every slot.
+int metrics_write(const char *path) {
+  static char text[METRICS_MAX * 128];
+  struct metrics *m = current != NULL ? current : &process;
+  char tmp[256];
+  size_t used = 0;
+  int i, fd, rc;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    fprintf(stderr, "Cannot write metrics file %s.\n", tmp);
+    return -1;
+  }
+
+  pthread_mutex_lock(&text_lock);
+  pthread_mutex_lock(&m->lock);
+  for(i = 0; i < m->count && used < sizeof(text); i++)
+    used += snprintf(text + used, sizeof(text) - used, "%s %.15g\n", m->series[i].name, m->series[i].value);
+  pthread_mutex_unlock(&m->lock);
+  if(used > sizeof(text)) used = sizeof(text);
+  rc = write(fd, text, used) == (ssize_t)used ? 0 : -1;
+  pthread_mutex_unlock(&text_lock);
+
+  if(close(fd) != 0 || rc < 0 || rename(tmp, path) != 0) {
+    fprintf(stderr, "Cannot write metrics file %s.\n", path);
+    return -1;
+  }
+
+  return 0;
+}
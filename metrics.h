@@ -0,0 +1,35 @@
+/* Metrics export in Prometheus text format.
+   Subsystems set named series, metrics_write() dumps them all to a
+   file suitable for the node_exporter textfile collector. Safe to use
+   from several threads. A program keeps one set of series for the
+   process; a library context brings its own and selects it with
+   metrics_use() in the thread it runs in, so contexts never overwrite
+   each other's series.
+   */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+
+#define METRICS_MAX 256   // Distinct series, extra ones are dropped
+
+struct metrics_series {
+  char name[96];          // Metric name including labels
+  double value;
+};
+
+struct metrics {
+  struct metrics_series series[METRICS_MAX];
+  int count;
+  pthread_mutex_t lock;   // Pipeline stages set series from their own threads
+};
+
+void metrics_init(struct metrics *m);
+void metrics_destroy(struct metrics *m);
+void metrics_use(struct metrics *m);
+void metrics_set(const char *series, double value);
+void metrics_add(const char *series, double value);
+int metrics_write(const char *path);
+
+#endif
@@ -0,0 +1,335 @@
+/* Multithreaded uploader, see pipeline.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>
+
+#include "pipeline.h"
+#include "metrics.h"
+
+struct pipe_line {
+  uint8_t type;
+  uint32_t deadline;            // PIPE_TICK after the slot went out at a deadline, 0 without one
+  uint32_t slot;
+  union {
+    char text[64];
+    struct shm_record record;   // PIPE_RECORD, a decode already in binary
+  };
+};
+
+struct pipe_spot {
+  uint8_t type;
+  uint32_t deadline;
+  uint32_t slot;
+  struct spot spot;
+};
+
+struct pipe_datagram {
+  uint8_t type;
+  uint32_t slot;
+  struct datagram d;
+};
+
+static const char *ring_name[PIPE_STAGES - 1] = { "lines", "spots", "datagrams" };
+
+static void pin(int32_t cpu) {
+  cpu_set_t set;
+
+  if(cpu < 0) return;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    fprintf(stderr, "Cannot pin thread to CPU %d.\n", cpu);
+}
+
+// Depth and mean occupancy of a ring, set by its producer only
+static void ring_metrics(struct ring *r, const char *name) {
+  char series[96];
+
+  snprintf(series, sizeof(series), "rbn_ring_depth{ring=\"%s\"}", name);
+  metrics_set(series, ring_depth(r));
+  snprintf(series, sizeof(series), "rbn_ring_occupancy_ratio{ring=\"%s\"}", name);
+  metrics_set(series, r->pushes ? (double)r->depth_sum / r->pushes / r->size : 0);
+  snprintf(series, sizeof(series), "rbn_ring_full_total{ring=\"%s\"}", name);
+  metrics_set(series, r->full);
+}
+
+static void *parser(void *arg) {
+  struct pipeline *p = arg;
+  struct uploader *u = p->u;
+  struct pipe_line in;
+  struct pipe_spot out;
+
+  pin(p->cpu[1]);
+
+  for(;;) {
+    ring_pop(&p->lines, &in);
+
+    switch(in.type) {
+      case PIPE_DATA:
+        if(uploader_parse(u, in.text, &out.spot)) {
+          out.type = PIPE_DATA;
+          ring_push(&p->spots, &out);
+        }
+        continue;
+      case PIPE_RECORD:
+        if(uploader_decode(u, &out.spot, in.record.time, in.record.sync, in.record.snr, in.record.dt,
+            in.record.freq, in.record.call, in.record.grid)) {
+          out.type = PIPE_DATA;
+          ring_push(&p->spots, &out);
+        }
+        continue;
+      case PIPE_TICK:
+        dtmon_flush(&u->clock, in.slot);
+        uploader_budget_parse(u);
+        metrics_set("rbn_lines", u->lines);
+        ring_metrics(&p->spots, ring_name[1]);
+        break;
+      case PIPE_SAVE:
+        if(u->first_path != NULL) heard_save(&u->first, u->first_path);
+        break;
+      case PIPE_RELOAD:
+        uploader_swap_parse(u);
+        break;
+    }
+
+    out.type = in.type;
+    out.deadline = in.deadline;
+    out.slot = in.slot;
+    ring_push(&p->spots, &out);
+    if(in.type == PIPE_STOP) return NULL;
+  }
+}
+
+static int push_datagram(void *ctx, const char *data, int32_t size, uint16_t gap) {
+  struct pipeline *p = ctx;
+  struct pipe_datagram out;
+
+  out.type = PIPE_DATA;
+  out.d.size = size;
+  out.d.gap = gap;
+  memcpy(out.d.data, data, size);
+  ring_push(&p->datagrams, &out);
+  return 0;
+}
+
+static void *encoder(void *arg) {
+  struct pipeline *p = arg;
+  struct uploader *u = p->u;
+  struct pipe_spot in;
+  struct pipe_datagram out;
+
+  pin(p->cpu[2]);
+
+  for(;;) {
+    ring_pop(&p->spots, &in);
+
+    switch(in.type) {
+      case PIPE_DATA:
+        if(!p->error && uploader_add(u, &in.spot) < 0) p->error = 1;
+        continue;
+      case PIPE_END:
+        if(!p->error && uploader_send(u) < 0) p->error = 1;
+        break;
+      case PIPE_TICK:
+        uploader_rollover(u);
+        if(in.deadline) u->deadline = in.deadline;
+        metrics_set("rbn_spots", u->parsed);
+        metrics_set("rbn_sent_bytes", u->totalsize);
+        metrics_set("rbn_duplicates", u->duplicates);
+        metrics_set("rbn_late_spots_total", u->late);
+        if(u->encode->backlog > 0) shed_report(&u->shed);
+        fresh_report(&u->fresh);
+        if(u->psk_target != NULL) {
+          psk_flush(&u->psk, time(NULL), 0);
+          psk_report(&u->psk);
+        }
+        if(u->cluster_addr != NULL) cluster_report(&u->cluster);
+        uploader_budget_encode(u);
+        ring_metrics(&p->datagrams, ring_name[2]);
+        break;
+      case PIPE_DUMP:
+        uploader_dump(u);
+        break;
+      case PIPE_SAVE:
+        if(u->heard_path != NULL)
+          hll_update(&u->heard, u->heard_path, u->last_day ? u->last_day - u->heard_days + 1 : 0);
+        break;
+      case PIPE_RELOAD:
+        uploader_swap_encode(u);
+        break;
+    }
+
+    out.type = in.type;
+    out.slot = in.slot;
+    ring_push(&p->datagrams, &out);
+    if(in.type == PIPE_STOP) return NULL;
+  }
+}
+
+static void *sender(void *arg) {
+  struct pipeline *p = arg;
+  struct uploader *u = p->u;
+  struct pipe_datagram in;
+
+  pin(p->cpu[3]);
+
+  for(;;) {
+    ring_pop(&p->datagrams, &in);
+
+    switch(in.type) {
+      case PIPE_DATA:
+        if(p->error) continue;
+        sender_burst_begin(&u->sender);
+        if(sender_queue(&u->sender, in.d.data, in.d.size, in.d.gap) < 0
+            || sender_flush(&u->sender) < 0) p->error = 1;
+        continue;
+      case PIPE_END:
+        sender_burst_end(&u->sender);
+        continue;
+      case PIPE_TICK:
+        alloc_check(in.slot);
+        metrics_set("rbn_burst_seconds", u->sender.burst_us / 1e6);
+        metrics_set("rbn_burst_overruns_total", u->sender.overruns);
+        if(u->metrics_path != NULL) metrics_write(u->metrics_path);
+        continue;
+      case PIPE_RELOAD:
+        u->reload_pending = RELOAD_NONE; // No stage reads the old config any more
+        continue;
+      case PIPE_STOP:
+        return NULL;
+    }
+  }
+}
+
+// Bytes of ring storage, for the memory budget before the pipeline starts
+size_t pipeline_memory(void) {
+  return arena_size(PIPE_RING * sizeof(struct pipe_line))
+    + arena_size(PIPE_RING * sizeof(struct pipe_spot)) + arena_size(PIPE_RING * sizeof(struct pipe_datagram));
+}
+
+// cpus is a comma separated CPU list for reader, parser, encoder and
+// sender, NULL or short to leave stages unpinned
+int pipeline_start(struct pipeline *p, struct uploader *u, const char *cpus) {
+  void *(*stage[PIPE_STAGES - 1])(void *) = { parser, encoder, sender };
+  sigset_t all, old;
+  char *end;
+  int32_t i;
+
+  memset(p, 0, sizeof(*p));
+  p->u = u;
+  for(i = 0; i < PIPE_STAGES; i++) p->cpu[i] = -1;
+  for(i = 0; cpus != NULL && *cpus && i < PIPE_STAGES; i++) {
+    p->cpu[i] = strtol(cpus, &end, 10);
+    if(end == cpus || (*end && *end != ',')) {
+      fprintf(stderr, "Cannot parse CPU list %s.\n", cpus);
+      return -1;
+    }
+    cpus = *end ? end + 1 : end;
+  }
+
+  if(arena_init(&p->arena, pipeline_memory()) < 0)
+    return -1;
+
+  if(ring_init(&p->lines, &p->arena, PIPE_RING, sizeof(struct pipe_line)) < 0
+      || ring_init(&p->spots, &p->arena, PIPE_RING, sizeof(struct pipe_spot)) < 0
+      || ring_init(&p->datagrams, &p->arena, PIPE_RING, sizeof(struct pipe_datagram)) < 0) {
+    fprintf(stderr, "Cannot allocate pipeline rings.\n");
+    return -1;
+  }
+
+  u->emit = push_datagram;
+  u->emit_ctx = p;
+
+  // Stages never take signals, the reader thread handles them
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  pin(p->cpu[0]);
+  for(i = 0; i < PIPE_STAGES - 1; i++)
+    if(pthread_create(&p->thread[i], NULL, stage[i], p) != 0) {
+      fprintf(stderr, "Cannot start pipeline thread.\n");
+      return -1;
+    }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  return 0;
+}
+
+// Feed one decode line, -1 once a stage has failed
+int pipeline_line(struct pipeline *p, const char *line) {
+  struct pipe_line in;
+
+  if(p->error) return -1;
+  in.type = PIPE_DATA;
+  snprintf(in.text, sizeof(in.text), "%s", line);
+  ring_push(&p->lines, &in);
+  p->pending = 1;
+  return 0;
+}
+
+// Feed one binary decode, -1 once a stage has failed
+int pipeline_record(struct pipeline *p, const struct shm_record *r) {
+  struct pipe_line in;
+
+  if(p->error) return -1;
+  in.type = PIPE_RECORD;
+  in.record = *r;
+  in.record.call[sizeof(in.record.call) - 1] = 0;
+  in.record.grid[sizeof(in.record.grid) - 1] = 0;
+  ring_push(&p->lines, &in);
+  p->pending = 1;
+  return 0;
+}
+
+// End marks without lines since the last one are dropped, so are
+// reload marks without a loaded config
+void pipeline_mark(struct pipeline *p, uint8_t type, uint32_t slot) {
+  struct pipe_line in;
+
+  if(type == PIPE_END && !p->pending) return;
+  if(type == PIPE_END) p->pending = 0;
+  if(type == PIPE_RELOAD) {
+    if(p->u->reload_pending != RELOAD_LOADED) return;
+    p->u->reload_pending = RELOAD_SWAPPING;
+  }
+
+  in.type = type;
+  in.deadline = 0;
+  in.slot = slot;
+  ring_push(&p->lines, &in);
+}
+
+// Slot tick, with the slot key of the next slot if the slot's spots
+// were sent at a deadline so that spots of it arriving later count as late
+void pipeline_tick(struct pipeline *p, uint32_t slot, uint32_t deadline) {
+  struct pipe_line in;
+
+  ring_metrics(&p->lines, ring_name[0]);
+  in.type = PIPE_TICK;
+  in.deadline = deadline;
+  in.slot = slot;
+  ring_push(&p->lines, &in);
+}
+
+// Drain and join every stage, -1 if any failed
+int pipeline_stop(struct pipeline *p) {
+  struct ring *r[PIPE_STAGES - 1] = { &p->lines, &p->spots, &p->datagrams };
+  int32_t i;
+
+  pipeline_mark(p, PIPE_END, 0);
+  pipeline_mark(p, PIPE_STOP, 0);
+  for(i = 0; i < PIPE_STAGES - 1; i++) pthread_join(p->thread[i], NULL);
+
+  p->u->emit = NULL;
+  for(i = 0; i < PIPE_STAGES - 1; i++) {
+    ring_metrics(r[i], ring_name[i]);
+    if(p->u->verbose)
+      printf("Ring %-9s: mean depth %.1f of %u, max %u, full %u\n", ring_name[i],
+        r[i]->pushes ? (double)r[i]->depth_sum / r[i]->pushes : 0, r[i]->size, r[i]->depth_max, r[i]->full);
+  }
+  arena_free(&p->arena);
+
+  return p->error ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+/* Multithreaded uploader: reader, parser, encoder and sender stages
+   connected by bounded SPSC rings. The caller is the reader and feeds
+   lines and control marks; the parser runs uploader_parse(), the
+   encoder uploader_add() and uploader_send(), the sender paces the
+   datagrams out. Marks travel through every ring behind the data
+   before them, so each stage handles a tick, dump or save on its own
+   state at the right point in the stream and no state is shared. A
+   reload mark swaps the config in the parser, rebinds the per band
+   files in the encoder and frees the spare config in the sender. A
+   full ring stalls the stage feeding it, back to the reader.
+   */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ring.h"
+#include "shmring.h"
+#include "uploader.h"
+
+#define PIPE_RING 1024        // Items per ring
+#define PIPE_STAGES 4         // Reader, parser, encoder, sender
+
+enum { PIPE_DATA, PIPE_RECORD, PIPE_END, PIPE_TICK, PIPE_DUMP, PIPE_SAVE, PIPE_RELOAD, PIPE_STOP };
+
+struct pipeline {
+  struct uploader *u;
+  struct arena arena;         // Ring storage
+  struct ring lines;          // Reader to parser
+  struct ring spots;          // Parser to encoder
+  struct ring datagrams;      // Encoder to sender
+  pthread_t thread[PIPE_STAGES - 1];
+  int32_t cpu[PIPE_STAGES];   // CPU per stage, -1 if not pinned
+  int32_t pending;            // Lines fed since the last end mark
+  _Atomic int32_t error;      // A stage failed, the rest drain and drop
+};
+
+size_t pipeline_memory(void);
+int pipeline_start(struct pipeline *p, struct uploader *u, const char *cpus);
+int pipeline_line(struct pipeline *p, const char *line);
+int pipeline_record(struct pipeline *p, const struct shm_record *r);
+void pipeline_mark(struct pipeline *p, uint8_t type, uint32_t slot);
+void pipeline_tick(struct pipeline *p, uint32_t slot, uint32_t deadline);
+int pipeline_stop(struct pipeline *p);
+
+#endif
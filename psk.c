@@ -0,0 +1,233 @@
+/* PSK Reporter sink, see psk.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "psk.h"
+#include "metrics.h"
+
+#define PSK_HEADER 16             // IPFIX message header
+#define PSK_SET 4                 // Set id and length
+
+// Receiver options template 0x9992 and sender template 0x9993, fields
+// of enterprise 30351 (0x768f) plus flowStartSeconds
+static const uint8_t templates[] = {
+  0x00, 0x03, 0x00, 0x2c, 0x99, 0x92, 0x00, 0x04, 0x00, 0x00,
+  0x80, 0x02, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // receiverCallsign
+  0x80, 0x04, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // receiverLocator
+  0x80, 0x08, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // decodingSoftware
+  0x80, 0x09, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // antennaInformation
+  0x00, 0x00,
+  0x00, 0x02, 0x00, 0x2c, 0x99, 0x93, 0x00, 0x05,
+  0x80, 0x01, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // senderCallsign
+  0x80, 0x05, 0x00, 0x04, 0x00, 0x00, 0x76, 0x8f,   // frequency
+  0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x76, 0x8f,   // sNR
+  0x80, 0x0a, 0xff, 0xff, 0x00, 0x00, 0x76, 0x8f,   // mode
+  0x00, 0x96, 0x00, 0x04                            // flowStartSeconds
+};
+
+static uint8_t *put16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+  return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+  return p + 4;
+}
+
+// Variable length string, one length byte then the text
+static uint8_t *put_text(uint8_t *p, const char *text, size_t max) {
+  size_t n = strnlen(text, max);
+
+  *p++ = n;
+  memcpy(p, text, n);
+  return p + n;
+}
+
+size_t psk_memory(void) {
+  return arena_size(PSK_RECORDS) + arena_size(2 * PSK_CALLS * sizeof(uint64_t));
+}
+
+static int resolve(struct psk *p, const char *target) {
+  struct addrinfo hints, *res;
+  char host[256];
+  const char *colon = strrchr(target, ':');
+
+  snprintf(host, sizeof(host), "%.*s", colon != NULL ? (int)(colon - target) : (int)strlen(target), target);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if(getaddrinfo(host, NULL, &hints, &res) != 0) return -1;
+
+  memset(&p->addr, 0, sizeof(p->addr));
+  p->addr = *(struct sockaddr_in *)res->ai_addr;
+  p->addr.sin_port = htons(colon != NULL ? atoi(colon + 1) : PSK_PORT);
+  freeaddrinfo(res);
+  return 0;
+}
+
+// target is host[:port], the receiver fields go into every packet.
+// The buffers come from a, which needs psk_memory() bytes.
+int psk_open(struct psk *p, struct arena *a, const char *target, const char *call, const char *locator,
+    const char *antenna, const char *mode) {
+  uint8_t *r;
+
+  memset(p, 0, sizeof(*p));
+  p->sock = -1;
+  snprintf(p->mode, sizeof(p->mode), "%s", mode);
+  p->domain = (uint32_t)time(NULL) ^ (uint32_t)getpid() << 16;
+
+  r = put_text(p->receiver, call, 32);
+  r = put_text(r, locator, 8);
+  r = put_text(r, "upload-to-rbn", 32);
+  r = put_text(r, antenna, 64);
+  p->receiver_size = r - p->receiver;
+
+  if((p->records = arena_alloc(a, PSK_RECORDS)) == NULL
+      || (p->seen = arena_alloc(a, 2 * PSK_CALLS * sizeof(uint64_t))) == NULL) {
+    fprintf(stderr, "Cannot allocate PSK Reporter buffers.\n");
+    return -1;
+  }
+  memset(p->seen, 0, 2 * PSK_CALLS * sizeof(uint64_t));
+
+  if(resolve(p, target) < 0) {
+    fprintf(stderr, "Cannot resolve PSK Reporter address %s.\n", target);
+    return -1;
+  }
+
+  if((p->sock = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP)) < 0) {
+    fprintf(stderr, "Cannot open socket.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Send what is left
+void psk_close(struct psk *p) {
+  if(p->sock < 0) return;
+  psk_flush(p, time(NULL), 1);
+  close(p->sock);
+  p->sock = -1;
+}
+
+// Bytes of the sender record at r
+static uint32_t record_size(const struct psk *p, const uint8_t *r) {
+  return 1 + r[0] + 4 + 1 + 1 + strlen(p->mode) + 4;
+}
+
+// Send records [from, to) as one message
+static void send_packet(struct psk *p, uint32_t from, uint32_t to, uint32_t records, uint32_t now) {
+  uint8_t packet[PSK_PACKET + 8], *q = packet + PSK_HEADER, *set;
+  int templated = p->packets < PSK_TEMPLATES || now - p->templates_at >= PSK_TEMPLATE_EVERY;
+
+  if(templated) {
+    memcpy(q, templates, sizeof(templates));
+    q += sizeof(templates);
+    p->templates_at = now;
+  }
+
+  set = q;
+  q = put16(q, 0x9992) + 2;
+  memcpy(q, p->receiver, p->receiver_size);
+  q += p->receiver_size;
+  while((q - set) % 4) *q++ = 0;
+  put16(set + 2, q - set);
+
+  set = q;
+  q = put16(q, 0x9993) + 2;
+  memcpy(q, p->records + from, to - from);
+  q += to - from;
+  while((q - set) % 4) *q++ = 0;
+  put16(set + 2, q - set);
+
+  put16(packet, 0x000a);
+  put16(packet + 2, q - packet);
+  put32(packet + 4, now);
+  put32(packet + 8, p->sequence);
+  put32(packet + 12, p->domain);
+  p->sequence += records + 1;
+
+  if(sendto(p->sock, packet, q - packet, 0, (struct sockaddr *)&p->addr, sizeof(p->addr)) != q - packet) p->errors++;
+  p->packets++;
+}
+
+/* Report what collected once PSK_INTERVAL has passed since its first
+   record, or at once with force. Records are packed into as few
+   datagrams as fit. */
+void psk_flush(struct psk *p, uint32_t now, int force) {
+  uint32_t room, from = 0, at = 0, size, records = 0;
+
+  if(!p->used || (!force && now - p->started < PSK_INTERVAL)) return;
+
+  // Room left for sender records once header, templates and receiver set are in
+  room = PSK_PACKET - PSK_HEADER - sizeof(templates) - PSK_SET - (p->receiver_size + 3) / 4 * 4 - PSK_SET - 3;
+  while(at < p->used) {
+    size = record_size(p, p->records + at);
+    if(at + size - from > room) {
+      send_packet(p, from, at, records, now);
+      from = at;
+      records = 0;
+    }
+    at += size;
+    records++;
+  }
+  send_packet(p, from, at, records, now);
+
+  p->used = 0;
+  p->started = 0;
+  memset(p->seen, 0, 2 * PSK_CALLS * sizeof(uint64_t));
+  p->seen_count = 0;
+}
+
+// Collect a spot unless the call was already reported on this band
+// in this interval
+void psk_add(struct psk *p, const char *call, uint64_t hash, int32_t freq, int32_t bfreq, int32_t snr, uint32_t when) {
+  uint64_t key = (hash ^ (uint64_t)(bfreq / 1000) * 0x9e3779b97f4a7c15ull) | 1;
+  uint32_t i, mask = 2 * PSK_CALLS - 1;
+  uint8_t *r;
+
+  if(p->sock < 0) return;
+
+  for(i = key & mask; p->seen[i]; i = (i + 1) & mask)
+    if(p->seen[i] == key) {
+      p->repeats++;
+      return;
+    }
+
+  // Full buffer or call table, report now and start over
+  if(p->used + 32 + sizeof(p->mode) > PSK_RECORDS || p->seen_count == PSK_CALLS) {
+    psk_flush(p, time(NULL), 1);
+    for(i = key & mask; p->seen[i]; i = (i + 1) & mask);
+  }
+
+  p->seen[i] = key;
+  p->seen_count++;
+  if(!p->started) p->started = time(NULL);
+
+  r = put_text(p->records + p->used, call, 13);
+  r = put32(r, freq);
+  *r++ = (int8_t)snr;
+  r = put_text(r, p->mode, sizeof(p->mode));
+  r = put32(r, when);
+  p->used = r - p->records;
+  p->spots++;
+}
+
+void psk_report(const struct psk *p) {
+  metrics_set("rbn_psk_spots_total", p->spots);
+  metrics_set("rbn_psk_repeats_total", p->repeats);
+  metrics_set("rbn_psk_packets_total", p->packets);
+  metrics_set("rbn_psk_errors_total", p->errors);
+}
@@ -0,0 +1,55 @@
+/* PSK Reporter sink.
+   Spots parsed for RBN also go to PSK Reporter, as the IPFIX receiver
+   and sender records of Pavel Demin's upload-to-pskreporter, so one
+   process parses each decode file once for both networks. PSK
+   Reporter wants few, full packets: sender records collect for
+   PSK_INTERVAL seconds with each call at most once per band, then go
+   out in datagrams of up to PSK_PACKET bytes that each repeat the
+   receiver record. The first packets, and then one an hour, also
+   carry the templates. Buffers come from the uploader's arena, a full
+   buffer is reported early.
+   */
+
+#ifndef PSK_H
+#define PSK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "alloc.h"
+
+#define PSK_PORT 4739             // report.pskreporter.info
+#define PSK_INTERVAL 300          // Seconds between reports, PSK Reporter asks for 5 minutes
+#define PSK_PACKET 1400           // Largest datagram
+#define PSK_RECORDS 65536         // Bytes of sender records held between reports
+#define PSK_CALLS 8192            // Calls per band in one report, a power of two
+#define PSK_TEMPLATES 3           // Leading packets that carry the templates
+#define PSK_TEMPLATE_EVERY 3600   // Seconds between later template packets
+
+struct psk {
+  int sock;
+  struct sockaddr_in addr;
+  uint8_t receiver[160];          // Encoded receiver data record
+  uint16_t receiver_size;
+  char mode[8];                   // Mode of every sender record, FT8 or FT4
+  uint32_t domain;                // Observation domain, random per run
+  uint32_t sequence;              // Data records sent, for the IPFIX header
+  uint32_t templates_at;          // Time the templates last went out
+  uint32_t started;               // When the first record of this report arrived, 0 if none
+  uint8_t *records;               // Encoded sender records
+  uint32_t used;                  // Bytes in records
+  uint64_t *seen;                 // Call and band keys reported, 2 * PSK_CALLS slots
+  uint32_t seen_count;
+  uint32_t spots, repeats, packets, errors;
+};
+
+size_t psk_memory(void);
+int psk_open(struct psk *p, struct arena *a, const char *target, const char *call, const char *locator,
+  const char *antenna, const char *mode);
+void psk_close(struct psk *p);
+void psk_add(struct psk *p, const char *call, uint64_t hash, int32_t freq, int32_t bfreq, int32_t snr, uint32_t when);
+void psk_flush(struct psk *p, uint32_t now, int force);
+void psk_report(const struct psk *p);
+
+#endif
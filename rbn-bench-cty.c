@@ -0,0 +1,122 @@
+/* Benchmark of DXCC entity resolution.
+   Loads a cty.dat, makes synthetic calls from its prefixes and times
+   cty_lookup() against a naive scan that checks the exception calls
+   and then every prefix for the longest match, the way a first
+   version without a trie would. Prints the time per call of both and
+   the number of calls on which they disagree, which should be none.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cty.h"
+
+struct prefix {
+  char text[16];
+  int32_t entity;
+  int32_t exact;          // Whole call exception, =CALL
+};
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Every prefix and exception of the file with its entity, zone overrides cut off
+static struct prefix *read_prefixes(const char *path, uint32_t *count) {
+  struct prefix *p = NULL, *grown;
+  uint32_t size = 0;
+  int32_t entity = -1;
+  char line[4096], *token;
+  FILE *fp;
+
+  if((fp = fopen(path, "r")) == NULL) return NULL;
+
+  *count = 0;
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    if(line[0] != ' ' && line[0] != '\t') {
+      entity++;
+      continue;
+    }
+    for(token = strtok(line, " \t,;\r\n"); token != NULL; token = strtok(NULL, " \t,;\r\n")) {
+      if(*count == size) {
+        size = size ? 2 * size : 1024;
+        if((grown = realloc(p, size * sizeof(*p))) == NULL) break;
+        p = grown;
+      }
+      p[*count].exact = *token == '=';
+      snprintf(p[*count].text, sizeof(p[*count].text), "%.*s", (int)strcspn(token + p[*count].exact, "([<{~"),
+        token + p[*count].exact);
+      p[*count].entity = entity;
+      (*count)++;
+    }
+  }
+
+  fclose(fp);
+  return p;
+}
+
+// A later line wins over an earlier one, as it does when cty_load() builds the trie
+static int32_t naive(const struct prefix *p, uint32_t count, const char *call) {
+  uint32_t i, length, best = 0;
+  int32_t entity = CTY_NONE;
+
+  for(i = count; i-- > 0;)
+    if(p[i].exact && strcmp(p[i].text, call) == 0) return p[i].entity;
+
+  for(i = 0; i < count; i++) {
+    length = strlen(p[i].text);
+    if(!p[i].exact && length && length >= best && strncmp(call, p[i].text, length) == 0) {
+      best = length;
+      entity = p[i].entity;
+    }
+  }
+  return entity;
+}
+
+int main(int argc, char *argv[]) {
+  struct cty c;
+  struct prefix *p;
+  char (*calls)[16];
+  uint32_t i, count, n = argc > 2 ? atoi(argv[2]) : 100000, sum = 0, mismatches = 0;
+  double start, trie;
+
+  if(argc < 2 || !n) {
+    fprintf(stderr, "Usage: %s <cty.dat> [calls]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if(cty_load(&c, argv[1]) < 0) return EXIT_FAILURE;
+  if((p = read_prefixes(argv[1], &count)) == NULL || (calls = malloc((size_t)n * sizeof(*calls))) == NULL) {
+    fprintf(stderr, "Cannot read %s.\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // Prefix, area digit and suffix, a few of them exception calls
+  srand(2);
+  for(i = 0; i < n; i++)
+    if(p[i % count].exact) snprintf(calls[i], sizeof(calls[i]), "%s", p[i % count].text);
+    else snprintf(calls[i], sizeof(calls[i]), "%.9s%d%c%c", p[rand() % count].text, rand() % 10,
+      'A' + rand() % 26, 'A' + rand() % 26);
+
+  start = now();
+  for(i = 0; i < 10 * n; i++) sum += cty_lookup(&c, calls[i % n])->entity;
+  trie = (now() - start) * 1e9 / (10.0 * n);
+  printf("trie   %8.1f ns per call (%u entities, %u prefixes and exceptions, %u nodes)\n", trie, c.entities, count,
+    c.nodes);
+
+  start = now();
+  for(i = 0; i < n; i++)
+    if(naive(p, count, calls[i]) != cty_lookup(&c, calls[i])->entity) mismatches++;
+  printf("linear %8.1f ns per call, %u mismatches\n", (now() - start) * 1e9 / n, mismatches);
+
+  if(!sum) printf("unexpected result\n");
+  cty_free(&c);
+  free(calls);
+  free(p);
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/* Benchmark of the call sign interning table.
+   Interns a number of unique synthetic calls, then looks them up
+   again in a scattered order, and prints the table memory per call
+   with the time per insert and per lookup. For comparison it stores
+   the same calls as the char[16] strings they replaced and times the
+   string compares a linear scan over them needs, against the integer
+   compares of ids.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "intern.h"
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  struct intern t;
+  char (*calls)[16];
+  uint32_t i, n = argc > 1 ? atoi(argv[1]) : 100000, *ids, sum = 0, hits = 0;
+  double start;
+
+  if(!n || (calls = malloc((size_t)n * sizeof(*calls))) == NULL || (ids = malloc((size_t)n * sizeof(*ids))) == NULL
+      || intern_init(&t, 1024) < 0) {
+    fprintf(stderr, "Usage: %s [unique calls]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(i = 0; i < n; i++)
+    snprintf(calls[i], sizeof(calls[i]), "%c%c%u%c%c%c", 'A' + i % 26, 'A' + i / 26 % 26, i / 676 % 10,
+      'A' + i / 6760 % 26, 'A' + i / 175760 % 26, 'A' + i / 4569760 % 26);
+
+  start = now();
+  for(i = 0; i < n; i++) ids[i] = intern_call(&t, calls[i]);
+  printf("%u calls, %zu bytes, %.1f bytes per call\n", t.count, intern_memory(&t), (double)intern_memory(&t) / t.count);
+  printf("insert %.1f ns per call\n", (now() - start) * 1e9 / n);
+
+  start = now();
+  for(i = 0; i < 10 * n; i++) sum += intern_call(&t, calls[(uint64_t)i * 7919 % n]);
+  printf("lookup %.1f ns per call\n", (now() - start) * 1e9 / (10.0 * n));
+
+  // What the ids replaced: 16 bytes per spot and a string compare per match
+  start = now();
+  for(i = 0; i < n; i++) hits += strcmp(calls[i], calls[n / 2]) == 0;
+  printf("scan of char[16] calls %.2f ns per spot, %zu bytes per spot\n", (now() - start) * 1e9 / n, sizeof(calls[0]));
+  start = now();
+  for(i = 0; i < n; i++) hits += ids[i] == ids[n / 2];
+  printf("scan of ids            %.2f ns per spot, %zu bytes per spot\n", (now() - start) * 1e9 / n, sizeof(ids[0]));
+
+  if(sum == 0 || hits != 2) printf("unexpected result\n");
+  intern_free(&t);
+  free(calls);
+  free(ids);
+  return EXIT_SUCCESS;
+}
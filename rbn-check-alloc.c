@@ -0,0 +1,83 @@
+/* Steady state allocation check, run by make check.
+   Built with ALLOC_COUNT and interpose.c, it feeds the decode files
+   given, one slot each, through uploader_line(), uploader_send(),
+   uploader_rollover() and uploader_tick() for several rounds, with the
+   datagrams going nowhere. Files are read up front with read(), so
+   the only allocations counted are the uploader's. Exits non-zero if
+   any slot after the first ALLOC_WARMUP allocates.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "uploader.h"
+
+#define CHECK_ROUNDS 3        // Passes over the files
+#define CHECK_FILES 64
+#define CHECK_BYTES (1 << 20) // All decode files together
+
+static char data[CHECK_BYTES];
+static size_t start[CHECK_FILES + 1];
+
+static int discard(void *ctx, const char *data, int32_t size, uint16_t gap) {
+  (void)ctx;
+  (void)data;
+  (void)size;
+  (void)gap;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static struct uploader u;
+  char line[64], *p, *end;
+  uint64_t before, warmup = 0, after = 0;
+  uint32_t slot = 1552204800, slots = 0, failed = 0;
+  int32_t i, files = argc - 1, round, fd;
+  ssize_t size;
+
+  if(files < 1 || files > CHECK_FILES) {
+    fprintf(stderr, "Usage: %s <Decode file>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(i = 0; i < files; i++) {
+    start[i + 1] = start[i];
+    if((fd = open(argv[i + 1], O_RDONLY)) < 0) {
+      fprintf(stderr, "Cannot open input file %s.\n", argv[i + 1]);
+      return EXIT_FAILURE;
+    }
+    while((size = read(fd, data + start[i + 1], CHECK_BYTES - 1 - start[i + 1])) > 0) start[i + 1] += size;
+    close(fd);
+  }
+
+  config_default(&u.configs[0]);
+  if(uploader_open(&u, "127.0.0.1", 9, 1) < 0) return EXIT_FAILURE;
+  u.emit = discard;
+
+  for(round = 0; round < CHECK_ROUNDS; round++)
+    for(i = 0; i < files; i++, slot += SLOT_SECONDS, slots++) {
+      before = alloc_count();
+      for(p = data + start[i]; p < data + start[i + 1]; p = end + 1) {
+        if((end = memchr(p, '\n', data + start[i + 1] - p)) == NULL) end = data + start[i + 1];
+        snprintf(line, sizeof(line), "%.*s", (int)(end - p), p);
+        if(uploader_line(&u, line) < 0) return EXIT_FAILURE;
+      }
+      if(uploader_send(&u) < 0) return EXIT_FAILURE;
+      uploader_rollover(&u);
+      uploader_tick(&u, slot);
+
+      if(slots < ALLOC_WARMUP) warmup += alloc_count() - before;
+      else if(alloc_count() != before) {
+        after += alloc_count() - before;
+        failed++;
+      }
+    }
+
+  printf("%u slots, %llu allocations in warm-up, %llu in %u slots after it\n", slots,
+    (unsigned long long)warmup, (unsigned long long)after, failed);
+  uploader_close(&u);
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
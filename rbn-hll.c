@@ -0,0 +1,56 @@
+/* Report and merge distinct call counts kept by upload-to-rbn -H.
+   Files from several receivers are merged sketch by sketch, the
+   report lists each band per day and each band over all days given.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "hll.h"
+
+int main(int argc, char *argv[]) {
+  struct hll_set set, total;
+  struct hll_record *r;
+  char *output = NULL, stamp[16];
+  uint32_t i;
+  int opt;
+  time_t t;
+
+  while((opt = getopt(argc, argv, "o:")) != -1) {
+    switch(opt) {
+      case 'o': output = optarg; break; // Write merged sketches here
+      default: argc = 0;
+    }
+  }
+
+  if(optind >= argc) {
+    fprintf(stderr, "Usage: %s [-o merged file] <call count file>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  hll_init(&set);
+  hll_init(&total);
+
+  for(; optind < argc; optind++)
+    if(hll_load(&set, argv[optind]) < 0) return EXIT_FAILURE;
+
+  for(i = 0; i < set.count; i++) {
+    r = &set.record[i];
+    t = (time_t)r->day * 86400;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d", gmtime(&t));
+    printf("%s %8d %6.0f\n", stamp, r->base, hll_estimate(r));
+    hll_union(hll_get(&total, 0, r->base), r);
+  }
+
+  for(i = 0; i < total.count; i++)
+    printf("all        %8d %6.0f\n", total.record[i].base, hll_estimate(&total.record[i]));
+
+  if(output != NULL && hll_save(&set, output) < 0) return EXIT_FAILURE;
+
+  hll_free(&set);
+  hll_free(&total);
+  return EXIT_SUCCESS;
+}
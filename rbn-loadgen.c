@@ -0,0 +1,122 @@
+/* Multi-station load generator for upload-to-rbn -L.
+   Opens one TCP stream per simulated station and replays decode files
+   on each, stamped with the current slot so duplicates across stations
+   fall into the same slot as they would on the air. Every station
+   hears the same calls with its own SNR offset.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define MAX_STATIONS 256
+#define MAX_LINES 65536
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_relay(const char *spec) {
+  struct sockaddr_in addr;
+  char host[64];
+  const char *colon = strrchr(spec, ':');
+  int fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(atoi(colon != NULL ? colon + 1 : spec));
+  if(colon != NULL) {
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+    addr.sin_addr.s_addr = inet_addr(host);
+  }
+
+  if((fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0
+      || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "Cannot connect to %s.\n", spec);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// Decode line with the time of the current slot and the SNR moved by offset
+static int restamp(char *out, size_t size, const char *line, int offset) {
+  char stamp[16], rest[64];
+  double sync;
+  int snr;
+  time_t t = time(NULL) / 15 * 15;
+
+  if(strlen(line) < 14 || sscanf(line + 14, "%lf %d %63[^\n]", &sync, &snr, rest) != 3) return 0;
+  strftime(stamp, sizeof(stamp), "%y%m%d %H%M%S", gmtime(&t));
+  return snprintf(out, size, "%s %5.1f %3d %s\n", stamp, sync, snr + offset, rest);
+}
+
+int main(int argc, char *argv[]) {
+  static char lines[MAX_LINES][64];
+  int fd[MAX_STATIONS], opt, stations = 12, rate = 0, seconds = 10, i, size;
+  uint32_t count = 0, n = 0;
+  uint64_t sent = 0;
+  char buffer[128];
+  double start, elapsed;
+  FILE *fp;
+
+  while((opt = getopt(argc, argv, "n:r:t:")) != -1) {
+    switch(opt) {
+      case 'n': stations = atoi(optarg); break; // Simulated stations
+      case 'r': rate = atoi(optarg); break;     // Lines per second per station, 0 for flat out
+      case 't': seconds = atoi(optarg); break;  // Run time
+      default: argc = 0;
+    }
+  }
+
+  if(argc - optind < 2 || stations < 1 || stations > MAX_STATIONS) {
+    fprintf(stderr, "Usage: %s [-n stations] [-r lines per second] [-t seconds] <[address:]port> <decode file>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(i = optind + 1; i < argc; i++) {
+    if((fp = fopen(argv[i], "r")) == NULL) {
+      fprintf(stderr, "Cannot open input file %s.\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    while(count < MAX_LINES && fgets(lines[count], sizeof(lines[count]), fp) != NULL) count++;
+    fclose(fp);
+  }
+
+  if(!count) return EXIT_FAILURE;
+
+  for(i = 0; i < stations; i++)
+    if((fd[i] = connect_relay(argv[optind])) < 0) return EXIT_FAILURE;
+
+  // Round robin over the stations, one line each per turn
+  start = now();
+  while((elapsed = now() - start) < seconds) {
+    if(rate && n >= elapsed * rate) {
+      usleep(1000);
+      continue;
+    }
+    for(i = 0; i < stations; i++) {
+      if(!(size = restamp(buffer, sizeof(buffer), lines[n % count], i % 7 - 3))) continue;
+      if(write(fd[i], buffer, size) != size) {
+        fprintf(stderr, "Station %d lost its connection.\n", i);
+        return EXIT_FAILURE;
+      }
+      sent++;
+    }
+    n++;
+  }
+
+  for(i = 0; i < stations; i++) close(fd[i]);
+  printf("Stations: %d lines: %llu in %.1f s, %.0f lines/s\n", stations, (unsigned long long)sent, elapsed, sent / elapsed);
+  return EXIT_SUCCESS;
+}
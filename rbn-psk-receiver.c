@@ -0,0 +1,209 @@
+/* Stand-in PSK Reporter for upload-to-rbn -P.
+   Listens on a UDP port and decodes the IPFIX it receives the way a
+   collector would: templates are learned from template and options
+   template sets and data sets are only read through them, so a packet
+   that carries data before its template or has a bad set length is
+   reported rather than guessed at. Prints one line per data record,
+   then a summary once no packet arrived for the timeout.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_TEMPLATES 16
+#define MAX_FIELDS 16
+#define PSK_ENTERPRISE 30351
+
+struct field {
+  uint16_t id;                    // Element id without the enterprise bit
+  uint16_t length;                // 0xffff for variable length
+  uint32_t enterprise;
+};
+
+struct template {
+  uint16_t id;                    // 0 if unused
+  uint16_t count;
+  struct field field[MAX_FIELDS];
+};
+
+static struct template known[MAX_TEMPLATES];
+static unsigned packets, records, errors, unknown;
+
+static uint32_t get16(const uint8_t *p) {
+  return p[0] << 8 | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static const char *field_name(const struct field *f) {
+  if(f->enterprise == PSK_ENTERPRISE)
+    switch(f->id) {
+      case 1: return "sender";
+      case 2: return "receiver";
+      case 4: return "locator";
+      case 5: return "frequency";
+      case 6: return "snr";
+      case 8: return "software";
+      case 9: return "antenna";
+      case 10: return "mode";
+    }
+  if(!f->enterprise && f->id == 150) return "time";
+  return "unknown";
+}
+
+static struct template *find(uint16_t id) {
+  int i;
+
+  for(i = 0; i < MAX_TEMPLATES; i++)
+    if(known[i].id == id) return &known[i];
+  return NULL;
+}
+
+// Learn the templates of a set, scope is 1 for options templates
+static int learn(const uint8_t *p, const uint8_t *end, int scope) {
+  struct template *t;
+  uint16_t id, count, i;
+
+  while(end - p >= 4) {
+    id = get16(p);
+    count = get16(p + 2);
+    p += scope ? 6 : 4;
+    if(id < 256 || count > MAX_FIELDS || p > end) return -1;
+    if((t = find(id)) == NULL && (t = find(0)) == NULL) return -1;
+    t->id = id;
+    t->count = count;
+    for(i = 0; i < count; i++) {
+      if(end - p < 4) return -1;
+      t->field[i].id = get16(p) & 0x7fff;
+      t->field[i].length = get16(p + 2);
+      t->field[i].enterprise = 0;
+      p += 4;
+      if(get16(p - 4) & 0x8000) {
+        if(end - p < 4) return -1;
+        t->field[i].enterprise = get32(p);
+        p += 4;
+      }
+    }
+  }
+  return 0;
+}
+
+// Print the records of a data set, the rest after the last one is padding
+static int decode(const struct template *t, const uint8_t *p, const uint8_t *end) {
+  const struct field *f;
+  uint32_t length;
+  int i;
+
+  while(p < end && end - p >= 4) {
+    printf("%s", t->id == 0x9992 ? "receiver" : "record");
+    for(i = 0; i < t->count; i++) {
+      f = &t->field[i];
+      length = f->length;
+      if(length == 0xffff) {
+        if(p >= end) return -1;
+        length = *p++;
+        if(length == 255) {
+          if(end - p < 2) return -1;
+          length = get16(p);
+          p += 2;
+        }
+      }
+      if((uint32_t)(end - p) < length) return -1;
+      if(f->length == 0xffff) printf(" %s=%.*s", field_name(f), (int)length, p);
+      else if(length == 1) printf(" %s=%d", field_name(f), (int8_t)p[0]);
+      else if(length == 2) printf(" %s=%u", field_name(f), get16(p));
+      else if(length == 4) printf(" %s=%u", field_name(f), get32(p));
+      else printf(" %s=?", field_name(f));
+      p += length;
+    }
+    printf("\n");
+    records++;
+  }
+  return 0;
+}
+
+static void message(const uint8_t *p, ssize_t size) {
+  const uint8_t *set, *end = p + size;
+  const struct template *t;
+  uint16_t id, length;
+
+  packets++;
+  if(size < 16 || get16(p) != 10 || get16(p + 2) != size) {
+    fprintf(stderr, "Packet %u is not an IPFIX message.\n", packets);
+    errors++;
+    return;
+  }
+  printf("packet %u bytes=%zd sequence=%u domain=%08x\n", packets, size, get32(p + 8), get32(p + 12));
+
+  for(set = p + 16; end - set >= 4; set += length) {
+    id = get16(set);
+    length = get16(set + 2);
+    if(length < 4 || length > end - set || length % 4) {
+      fprintf(stderr, "Packet %u has a set of bad length %u.\n", packets, length);
+      errors++;
+      return;
+    }
+    if(id == 2 || id == 3) {
+      if(learn(set + 4, set + length, id == 3) < 0) {
+        fprintf(stderr, "Packet %u has a bad template set.\n", packets);
+        errors++;
+      }
+    }
+    else if((t = find(id)) == NULL) {
+      fprintf(stderr, "Packet %u has data for template %04x before its template.\n", packets, id);
+      unknown++;
+    }
+    else if(decode(t, set + 4, set + length) < 0) {
+      fprintf(stderr, "Packet %u has a bad data set.\n", packets);
+      errors++;
+    }
+  }
+  if(set != end) {
+    fprintf(stderr, "Packet %u has trailing bytes.\n", packets);
+    errors++;
+  }
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_in addr;
+  struct pollfd pfd;
+  uint8_t buffer[65536];
+  int opt, timeout = 10;
+  ssize_t size;
+
+  while((opt = getopt(argc, argv, "t:")) != -1) {
+    switch(opt) {
+      case 't': timeout = atoi(optarg); break; // Seconds without a packet before exiting
+      default: optind = argc + 1;
+    }
+  }
+
+  if(optind + 1 != argc) {
+    fprintf(stderr, "Usage: rbn-psk-receiver [-t seconds] port\n");
+    return EXIT_FAILURE;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(atoi(argv[optind]));
+  if((pfd.fd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0 || bind(pfd.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "Cannot listen on port %s.\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  pfd.events = POLLIN;
+  while(poll(&pfd, 1, timeout * 1000) > 0)
+    if((size = recv(pfd.fd, buffer, sizeof(buffer), 0)) > 0) message(buffer, size);
+
+  fprintf(stderr, "%u packets, %u records, %u sets before their template, %u errors\n", packets, records, unknown, errors);
+  close(pfd.fd);
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/* Reference producer for upload-to-rbn -R.
+   Replays decode files into the shared memory spot ring the way a
+   decoder would write its decodes. With -b it also receives the
+   datagrams upload-to-rbn sends and measures, record by record, the
+   time from writing the record to the decode datagram arriving.
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "shmring.h"
+
+#define MAX_SAMPLES 65536
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Decode line to record, 0 if it does not parse
+static int read_record(char *line, struct shm_record *r) {
+  struct tm tm;
+  char *src;
+  int snr;
+
+  memset(r, 0, sizeof(*r));
+  memset(&tm, 0, sizeof(tm));
+  if((src = strptime(line, "%y%m%d %H%M%S", &tm)) == NULL
+      || sscanf(src, "%lf %d %lf %d %13s %4s", &r->sync, &snr, &r->dt, &r->freq, r->call, r->grid) < 5) return 0;
+  r->time = timegm(&tm);
+  r->snr = snr;
+  return 1;
+}
+
+// Wait for the next decode datagram, 0 if none came within timeout ms
+static int wait_decode(int sock, int timeout) {
+  struct pollfd p = { sock, POLLIN, 0 };
+  unsigned char buf[512];
+  ssize_t size;
+
+  while(poll(&p, 1, timeout) > 0) {
+    if((size = recv(sock, buf, sizeof(buf), 0)) < 12) continue;
+    if(buf[11] == 2) return 1; // Message type 2 is a decode, 1 the status before it
+  }
+  return 0;
+}
+
+static int compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+  struct shmring ring;
+  struct shm_record r;
+  struct sockaddr_in addr;
+  uint64_t *sample = NULL;
+  uint32_t samples = 0, records = 0, full = 0, lost = 0;
+  int opt, port = 0, sock = -1, gap = 0;
+  char line[64];
+  FILE *fp;
+
+  while((opt = getopt(argc, argv, "b:i:")) != -1) {
+    switch(opt) {
+      case 'b': port = atoi(optarg); break; // Receive the datagrams here and measure latency
+      case 'i': gap = atoi(optarg); break;  // Microseconds between records
+      default: argc = 0;
+    }
+  }
+
+  if(argc - optind < 2) {
+    fprintf(stderr, "Usage: %s [-b port] [-i microseconds] <ring name> <decode file>...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if(shmring_open(&ring, argv[optind]) < 0) return EXIT_FAILURE;
+
+  if(port) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if((sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0
+        || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || (sample = malloc(MAX_SAMPLES * sizeof(*sample))) == NULL) {
+      fprintf(stderr, "Cannot listen on port %d.\n", port);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for(optind++; optind < argc; optind++) {
+    if((fp = fopen(argv[optind], "r")) == NULL) {
+      fprintf(stderr, "Cannot open input file %s.\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+    while(fgets(line, sizeof(line), fp) != NULL) {
+      if(!read_record(line, &r)) continue;
+      r.stamp = monotonic_ns();
+      if(shmring_push(&ring, &r) < 0) {
+        full++;
+        continue;
+      }
+      records++;
+
+      // One record in flight at a time; filtered decodes never arrive
+      if(port) {
+        if(wait_decode(sock, 50)) {
+          if(samples < MAX_SAMPLES) sample[samples++] = monotonic_ns() - r.stamp;
+        }
+        else lost++;
+      }
+      if(gap) usleep(gap);
+    }
+
+    fclose(fp);
+  }
+
+  printf("Records: %u written, %u dropped on a full ring\n", records, full);
+
+  if(port && samples) {
+    qsort(sample, samples, sizeof(*sample), compare);
+    printf("Latency write to datagram: %u samples, min %.1f us, median %.1f us, p99 %.1f us, max %.1f us\n",
+      samples, sample[0] / 1e3, sample[samples / 2] / 1e3, sample[samples * 99 / 100] / 1e3, sample[samples - 1] / 1e3);
+    printf("Records without a decode datagram (filtered): %u\n", lost);
+  }
+
+  free(sample);
+  if(sock >= 0) close(sock);
+  shmring_close(&ring);
+  return EXIT_SUCCESS;
+}
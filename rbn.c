@@ -0,0 +1,97 @@
+/* Embeddable uploader API, see rbn.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbn.h"
+#include "uploader.h"
+#include "metrics.h"
+
+// Each call works on the context's own metrics in the caller's thread
+// and leaves the thread on the process wide ones when it returns
+struct rbn_ctx {
+  struct uploader u;
+  struct metrics metrics;
+};
+
+// Open a context sending to ip and port, NULL on failure. o may be NULL.
+struct rbn_ctx *rbn_ctx_new(const char *ip, uint16_t port, const struct rbn_options *o) {
+  struct rbn_ctx *c;
+  struct uploader *u;
+
+  if((c = calloc(1, sizeof(*c))) == NULL) {
+    fprintf(stderr, "Cannot allocate uploader.\n");
+    return NULL;
+  }
+
+  u = &c->u;
+  metrics_init(&c->metrics);
+  config_default(&u->configs[0]);
+  if(o != NULL) {
+    u->config_path = (char *)o->config_path;
+    u->dedup_name = (char *)o->dedup_name;
+    u->metrics_path = (char *)o->metrics_path;
+    u->cty_path = (char *)o->cty_path;
+  }
+
+  // uploader_open() releases what it opened when it fails
+  metrics_use(&c->metrics);
+  if((u->config_path != NULL && config_load(&u->configs[0], u->config_path) < 0)
+      || uploader_open(u, ip, port, 1) < 0) {
+    metrics_use(NULL);
+    metrics_destroy(&c->metrics);
+    free(c);
+    return NULL;
+  }
+
+  metrics_use(NULL);
+  return c;
+}
+
+// Snap, filter and batch one decode. 1 if it will be sent, 0 if the
+// filters rejected it or the call table had no room for its call, -1
+// if memory ran out.
+int rbn_submit_spot(struct rbn_ctx *c, const struct rbn_spot *s) {
+  struct uploader *u = &c->u;
+  struct spot spot;
+  uint32_t skipped = u->uninterned;
+  int rc = 0;
+
+  metrics_use(&c->metrics);
+  if(uploader_decode(u, &spot, s->time, s->sync, s->snr, s->dt, s->freq, s->call, s->grid))
+    rc = uploader_add(u, &spot) < 0 ? -1 : u->uninterned == skipped;
+  metrics_use(NULL);
+  return rc;
+}
+
+// Send every spot submitted for the slot starting at slot, waiting out
+// the pacing gaps, then close its statistics. -1 if sending failed.
+int rbn_flush_slot(struct rbn_ctx *c, uint32_t slot) {
+  struct uploader *u = &c->u;
+  int rc = 0;
+
+  metrics_use(&c->metrics);
+  if(uploader_send(u) < 0 || sender_flush(&u->sender) < 0) rc = -1;
+  else {
+    uploader_rollover(u);
+    uploader_tick(u, slot + u->period);
+  }
+  metrics_use(NULL);
+  return rc;
+}
+
+// Send what is left and free the context
+void rbn_ctx_free(struct rbn_ctx *c) {
+  struct uploader *u = &c->u;
+
+  metrics_use(&c->metrics);
+  if(uploader_send(u) == 0) sender_flush(&u->sender);
+  uploader_rollover(u);
+  uploader_tick(u, UINT32_MAX);
+  uploader_save(u);
+  uploader_close(u);
+  metrics_use(NULL);
+  metrics_destroy(&c->metrics);
+  free(c);
+}
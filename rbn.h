@@ -0,0 +1,43 @@
+/* Embeddable uploader API, built as libupload-to-rbn.
+   A decoder that already holds its decodes in memory hands them over
+   as binary spots instead of writing decode lines for upload-to-rbn to
+   parse back. Spots are snapped to the band plan, filtered, encoded
+   and paced out to RBN Aggregator exactly as the command line tool
+   does, in the caller's thread. Not thread safe, one context per
+   thread. Each context keeps its own metrics, written to its own
+   metrics_path, and the archive exports nothing but these functions.
+   */
+
+#ifndef RBN_H
+#define RBN_H
+
+#include <stdint.h>
+
+// Only these functions are exported from the shared library
+#define RBN_API __attribute__((visibility("default")))
+
+struct rbn_ctx;
+
+struct rbn_options {
+  const char *config_path;        // Band plan and filters, NULL for the built-in plan
+  const char *dedup_name;         // Share duplicate table with other uploaders, NULL if unused
+  const char *metrics_path;       // Prometheus text file written every flush, NULL if unused
+  const char *cty_path;           // cty.dat for DXCC entities, NULL if unused
+};
+
+struct rbn_spot {
+  uint32_t time;                  // Decode time, seconds since the epoch UTC
+  int32_t freq;                   // Receive frequency in Hz, dial plus audio offset
+  int32_t snr;                    // dB
+  double dt;                      // Timing error in seconds
+  double sync;
+  const char *call;               // Up to 13 characters
+  const char *grid;               // Up to 4 characters, NULL or empty if unknown
+};
+
+RBN_API struct rbn_ctx *rbn_ctx_new(const char *ip, uint16_t port, const struct rbn_options *o);
+RBN_API int rbn_submit_spot(struct rbn_ctx *c, const struct rbn_spot *s);
+RBN_API int rbn_flush_slot(struct rbn_ctx *c, uint32_t slot);
+RBN_API void rbn_ctx_free(struct rbn_ctx *c);
+
+#endif
@@ -0,0 +1,510 @@
+/* Central relay for many receiving stations, see relay.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+
+#include "relay.h"
+#include "ring.h"
+#include "metrics.h"
+
+enum { RELAY_LINE, RELAY_END, RELAY_TICK, RELAY_STOP, RELAY_DATAGRAM };
+enum { EV_LISTEN, EV_SLOT, EV_SIGNAL, EV_CONN };   // EV_CONN + connection index
+
+#define LINE_MAX_LEN 64               // Same limit as the one-shot fgets()
+
+struct relay_item {
+  uint8_t type;
+  uint32_t slot;
+  char text[LINE_MAX_LEN];
+};
+
+// Worker to sender, a batch is datagrams up to a RELAY_END
+struct relay_datagram {
+  uint8_t type;
+  struct datagram d;
+};
+
+// One station's stream, from the connection pool
+struct relay_conn {
+  int fd;
+  size_t used;
+  char data[4096];
+};
+
+struct relay_target;
+
+struct relay_worker {
+  struct uploader u;
+  struct ring lines;                  // Acceptor to worker
+  struct ring datagrams;              // Worker to the sender of its target
+  struct relay_target *target;
+  pthread_t thread;
+  int32_t index;
+  int32_t pending;                    // Lines fed since the last end mark
+  int32_t batch;                      // Datagrams pushed since the last end mark
+  _Atomic int32_t error;
+};
+
+// The only sender towards one RBN Aggregator
+struct relay_target {
+  struct relay *relay;
+  struct sender sender;
+  int wake;                           // eventfd, written when a worker starts a batch
+  pthread_t thread;
+  int32_t index;
+  int32_t workers;                    // Workers sending through it
+  _Atomic int32_t stop;               // Set once the workers are gone
+  _Atomic int32_t error;
+};
+
+struct relay {
+  const struct config *config;        // Band plan used for routing
+  struct arena arena;                 // Workers, targets, rings and connections
+  struct pool conns;
+  struct relay_worker *worker;
+  struct relay_target *target;
+  int32_t workers, targets;
+  int epfd, listen, slot, signal;
+  uint32_t lines, connections, refused;
+};
+
+// Worker's emit, the first datagram of a batch wakes the sender
+static int push_datagram(void *ctx, const char *data, int32_t size, uint16_t gap) {
+  struct relay_worker *w = ctx;
+  struct relay_datagram out;
+  uint64_t one = 1;
+
+  out.type = RELAY_DATAGRAM;
+  out.d.size = size;
+  out.d.gap = gap;
+  memcpy(out.d.data, data, size);
+  ring_push(&w->datagrams, &out);
+  if(!w->batch++ && write(w->target->wake, &one, sizeof(one)) < 0) return -1;
+  return 0;
+}
+
+// End the batch of the last uploader call, the sender moves on to
+// other workers then, whose batches may change the base frequency
+static void close_batch(struct relay_worker *w) {
+  struct relay_datagram end;
+
+  end.type = RELAY_END;
+  ring_push(&w->datagrams, &end);
+  w->batch = 0;
+  if(w->target->workers > 1) w->u.prevbfreq = 0; // Restate it with the next status datagram
+}
+
+static void *worker_run(void *arg) {
+  struct relay_worker *w = arg;
+  struct uploader *u = &w->u;
+  struct relay_item in;
+  char series[64];
+
+  for(;;) {
+    ring_pop(&w->lines, &in);
+
+    switch(in.type) {
+      case RELAY_LINE:
+        if(!w->error && uploader_line(u, in.text) < 0) w->error = 1;
+        break;
+      case RELAY_END:
+        atomic_store(&u->sender.datagram_us, atomic_load(&w->target->sender.datagram_us)); // Shedding estimates
+        if(!w->error && uploader_send(u) < 0) w->error = 1;
+        break;
+      case RELAY_TICK:
+        uploader_rollover(u);
+        dtmon_flush(&u->clock, in.slot);
+        snprintf(series, sizeof(series), "rbn_relay_spots{worker=\"%d\"}", w->index);
+        metrics_set(series, u->parsed);
+        snprintf(series, sizeof(series), "rbn_relay_duplicates{worker=\"%d\"}", w->index);
+        metrics_set(series, u->duplicates);
+        snprintf(series, sizeof(series), "rbn_relay_sent_bytes{worker=\"%d\"}", w->index);
+        metrics_set(series, u->totalsize);
+        snprintf(series, sizeof(series), "rbn_relay_shed_spots{worker=\"%d\"}", w->index);
+        metrics_set(series, u->shed.collapsed + u->shed.dropped);
+        snprintf(series, sizeof(series), "rbn_relay_stale_spots{worker=\"%d\"}", w->index);
+        metrics_set(series, u->fresh.stale);
+        break;
+      case RELAY_STOP:
+        return NULL;
+    }
+
+    // A full batch may also go out early from uploader_line()
+    if(w->batch) close_batch(w);
+  }
+}
+
+// Send the batches of the target's workers, each from its first
+// datagram to its end mark, until the workers are gone
+static void *target_run(void *arg) {
+  struct relay_target *t = arg;
+  struct relay *r = t->relay;
+  struct relay_worker *w;
+  struct relay_datagram in;
+  uint64_t count;
+  int32_t busy, stop;
+  char series[64];
+
+  for(;;) {
+    if(read(t->wake, &count, sizeof(count)) < 0) continue;
+    stop = atomic_load(&t->stop); // Everything the workers pushed is in the rings then
+
+    do {
+      busy = 0;
+      for(w = r->worker + t->index; w < r->worker + r->workers; w += r->targets)
+        while(ring_try_pop(&w->datagrams, &in)) {
+          busy = 1;
+          sender_burst_begin(&t->sender);
+          for(; in.type == RELAY_DATAGRAM; ring_pop(&w->datagrams, &in))
+            if(!t->error && (sender_queue(&t->sender, in.d.data, in.d.size, in.d.gap) < 0
+                || sender_flush(&t->sender) < 0)) t->error = 1;
+        }
+    } while(busy);
+
+    sender_burst_end(&t->sender);
+    snprintf(series, sizeof(series), "rbn_relay_target_sent_bytes{target=\"%d\"}", t->index);
+    metrics_set(series, t->sender.bytes);
+    snprintf(series, sizeof(series), "rbn_relay_burst_seconds{target=\"%d\"}", t->index);
+    metrics_set(series, t->sender.burst_us / 1e6);
+    if(stop) return NULL;
+  }
+}
+
+static void push(struct relay_worker *w, uint8_t type, uint32_t slot) {
+  struct relay_item in;
+
+  in.type = type;
+  in.slot = slot;
+  ring_push(&w->lines, &in);
+}
+
+// The worker owning the band of the line's receive frequency, field six
+static struct relay_worker *route(struct relay *r, const char *line) {
+  const char *p = line;
+  int32_t i, bfreq;
+
+  for(i = 0; i < 5; i++) {
+    p += strspn(p, " \t");
+    p += strcspn(p, " \t\n");
+  }
+  return &r->worker[config_snap(r->config, strtol(p, NULL, 10), &bfreq) % r->workers];
+}
+
+static void feed_line(struct relay *r, const char *src, size_t size) {
+  struct relay_worker *w;
+  struct relay_item in;
+
+  if(size > LINE_MAX_LEN - 1) size = LINE_MAX_LEN - 1;
+  in.type = RELAY_LINE;
+  memcpy(in.text, src, size);
+  in.text[size] = 0;
+
+  w = route(r, in.text);
+  ring_push(&w->lines, &in);
+  w->pending = 1;
+  r->lines++;
+}
+
+static void drop_conn(struct relay *r, struct relay_conn *c) {
+  epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  pool_put(&r->conns, c);
+  r->connections--;
+}
+
+// Split what arrived into lines, keep the partial tail
+static void on_conn(struct relay *r, struct relay_conn *c) {
+  char *start, *end;
+  ssize_t size;
+
+  while((size = read(c->fd, c->data + c->used, sizeof(c->data) - c->used)) > 0) {
+    c->used += size;
+    for(start = c->data; (end = memchr(start, '\n', c->data + c->used - start)) != NULL; start = end + 1)
+      feed_line(r, start, end - start);
+    c->used -= start - c->data;
+    memmove(c->data, start, c->used);
+    if(c->used == sizeof(c->data)) c->used = 0; // Line too long, drop it
+  }
+
+  if(size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+    if(c->used) feed_line(r, c->data, c->used); // Last line without a newline
+    drop_conn(r, c);
+  }
+}
+
+static void on_listen(struct relay *r) {
+  struct epoll_event ev;
+  struct relay_conn *c;
+  int fd;
+
+  while((fd = accept4(r->listen, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+    if((c = pool_get(&r->conns)) == NULL) {
+      if(!r->refused++) fprintf(stderr, "Refusing stations beyond %d.\n", RELAY_CONNS);
+      close(fd);
+      continue;
+    }
+
+    c->fd = fd;
+    c->used = 0;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_CONN + pool_index(&r->conns, c);
+    if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      c->fd = -1;
+      pool_put(&r->conns, c);
+      continue;
+    }
+    r->connections++;
+  }
+}
+
+static int open_server(const char *spec) {
+  struct sockaddr_in addr;
+  char host[64];
+  const char *colon = strrchr(spec, ':');
+  int fd, on = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(atoi(colon != NULL ? colon + 1 : spec));
+  if(colon != NULL) {
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+    addr.sin_addr.s_addr = inet_addr(host);
+  }
+
+  if((fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)) < 0
+      || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+      || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+    fprintf(stderr, "Cannot listen on %s.\n", spec);
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int watch_fd(struct relay *r, int fd, uint32_t tag) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+  return epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Senders, workers, their uploaders and threads. Every worker copies
+// the options of proto and sends through target worker % targets.
+static int start_workers(struct relay *r, const struct uploader *proto, const struct relay_opts *o, const char *dedup) {
+  struct relay_worker *w;
+  struct relay_target *t;
+  sigset_t all, old;
+  int32_t i;
+
+  for(i = 0; i < r->targets; i++) {
+    t = &r->target[i];
+    t->relay = r;
+    t->index = i;
+    if((t->wake = eventfd(0, 0)) < 0 || sender_open(&t->sender, &r->arena, o->ip[i], o->port[i], 1) < 0) {
+      fprintf(stderr, "Cannot set up relay target %d.\n", i);
+      return -1;
+    }
+  }
+
+  for(i = 0; i < r->workers; i++) {
+    w = &r->worker[i];
+    memcpy(&w->u, proto, sizeof(w->u));
+    w->u.dedup_name = (char *)dedup;
+    w->index = i;
+    w->target = &r->target[i % r->targets];
+    w->target->workers++;
+    if(ring_init(&w->lines, &r->arena, RELAY_RING, sizeof(struct relay_item)) < 0
+        || ring_init(&w->datagrams, &r->arena, RELAY_RING, sizeof(struct relay_datagram)) < 0
+        || uploader_open(&w->u, o->ip[i % r->targets], o->port[i % r->targets], 1) < 0) {
+      fprintf(stderr, "Cannot set up relay worker %d.\n", i);
+      return -1;
+    }
+    w->u.emit = push_datagram;
+    w->u.emit_ctx = w;
+    w->u.clock.threshold = 0; // Decodes of many stations say nothing about one clock
+  }
+
+  // Workers and senders never take signals, the acceptor handles them
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  for(i = 0; i < r->targets; i++)
+    if(pthread_create(&r->target[i].thread, NULL, target_run, &r->target[i]) != 0) {
+      fprintf(stderr, "Cannot start relay sender.\n");
+      return -1;
+    }
+  for(i = 0; i < r->workers; i++)
+    if(pthread_create(&r->worker[i].thread, NULL, worker_run, &r->worker[i]) != 0) {
+      fprintf(stderr, "Cannot start relay worker.\n");
+      return -1;
+    }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  return 0;
+}
+
+// Accept station streams until SIGINT or SIGTERM, -1 on failure
+int relay_run(const struct uploader *proto, const struct relay_opts *o) {
+  struct epoll_event events[64];
+  struct itimerspec its;
+  struct signalfd_siginfo si;
+  struct relay r;
+  struct relay_worker *w;
+  struct relay_target *t;
+  struct relay_conn *c;
+  uint64_t expirations, one = 1;
+  sigset_t mask;
+  char dedup[64];
+  uint32_t slot;
+  int32_t i, n, running = 1, rc = 0;
+
+  if(proto->activity_path != NULL || proto->top_path != NULL || proto->heard_path != NULL || proto->first_path != NULL
+      || proto->archive_path != NULL || proto->psk_target != NULL
+      || proto->cluster_addr != NULL) {
+    fprintf(stderr, "Relay mode keeps no activity, top station, heard or archive files and feeds neither PSK Reporter nor a DX cluster.\n");
+    return -1;
+  }
+
+  // Relay tables are fixed pools, the budget is for uploaders on receiver boards
+  if(proto->configs[0].memory) {
+    fprintf(stderr, "Relay mode takes no memory budget.\n");
+    return -1;
+  }
+
+  memset(&r, 0, sizeof(r));
+  r.config = &proto->configs[0];
+  r.targets = o->targets;
+  r.workers = o->workers > 0 ? o->workers : sysconf(_SC_NPROCESSORS_ONLN);
+  if(r.workers < r.targets) r.workers = r.targets;
+  if(r.workers > RELAY_WORKERS) r.workers = RELAY_WORKERS;
+  r.epfd = r.listen = r.slot = r.signal = -1;
+
+  // Cross station duplicates need one table for all workers, private unless named
+  if(proto->dedup_name != NULL) snprintf(dedup, sizeof(dedup), "%s", proto->dedup_name);
+  else snprintf(dedup, sizeof(dedup), "/rbn-relay.%d", (int)getpid());
+
+  if(arena_init(&r.arena, r.workers * (arena_size(sizeof(struct relay_worker))
+      + arena_size(RELAY_RING * sizeof(struct relay_item)) + arena_size(RELAY_RING * sizeof(struct relay_datagram)))
+      + r.targets * (arena_size(sizeof(struct relay_target)) + arena_size(SENDER_QUEUE * sizeof(struct datagram)))
+      + arena_size(RELAY_CONNS * arena_size(sizeof(struct relay_conn))) + arena_size(RELAY_CONNS * sizeof(uint32_t))) < 0)
+    return -1;
+  r.worker = arena_alloc(&r.arena, r.workers * sizeof(*r.worker));
+  r.target = arena_alloc(&r.arena, r.targets * sizeof(*r.target));
+  if(pool_init(&r.conns, &r.arena, sizeof(struct relay_conn), RELAY_CONNS) < 0) return -1;
+  for(i = 0; i < RELAY_CONNS; i++) ((struct relay_conn *)pool_item(&r.conns, i))->fd = -1;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = (time(NULL) / SLOT_SECONDS + 1) * SLOT_SECONDS;
+  its.it_interval.tv_sec = SLOT_SECONDS;
+
+  if((r.epfd = epoll_create1(0)) < 0 || sigprocmask(SIG_BLOCK, &mask, NULL) < 0
+      || (r.signal = signalfd(-1, &mask, SFD_NONBLOCK)) < 0
+      || (r.slot = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) < 0
+      || timerfd_settime(r.slot, TFD_TIMER_ABSTIME, &its, NULL) < 0
+      || (r.listen = open_server(o->listen_addr)) < 0
+      || watch_fd(&r, r.listen, EV_LISTEN) < 0 || watch_fd(&r, r.slot, EV_SLOT) < 0
+      || watch_fd(&r, r.signal, EV_SIGNAL) < 0) {
+    fprintf(stderr, "Cannot set up relay.\n");
+    return -1;
+  }
+
+  if(start_workers(&r, proto, o, dedup) < 0) return -1;
+
+  while(running) {
+    if((n = epoll_wait(r.epfd, events, 64, -1)) < 0) {
+      if(errno == EINTR) continue;
+      fprintf(stderr, "epoll_wait() failed.\n");
+      rc = -1;
+      break;
+    }
+
+    for(i = 0; i < n; i++)
+      switch(events[i].data.u32) {
+        case EV_LISTEN: on_listen(&r); break;
+        case EV_SLOT:
+          if(read(r.slot, &expirations, sizeof(expirations)) < 0) break;
+          slot = time(NULL) / SLOT_SECONDS * SLOT_SECONDS - SLOT_SECONDS;
+          for(w = r.worker; w < r.worker + r.workers; w++) push(w, RELAY_TICK, slot);
+          metrics_set("rbn_relay_connections", r.connections);
+          metrics_set("rbn_relay_lines", r.lines);
+          if(proto->metrics_path != NULL) metrics_write(proto->metrics_path);
+          break;
+        case EV_SIGNAL:
+          while(read(r.signal, &si, sizeof(si)) == sizeof(si)) running = 0;
+          break;
+        default: on_conn(&r, pool_item(&r.conns, events[i].data.u32 - EV_CONN)); break;
+      }
+
+    // Each worker sends what it got before the loop sleeps again
+    for(w = r.worker; w < r.worker + r.workers; w++) {
+      if(w->error) rc = -1;
+      if(!w->pending) continue;
+      push(w, RELAY_END, 0);
+      w->pending = 0;
+    }
+    for(t = r.target; t < r.target + r.targets; t++)
+      if(t->error) rc = -1;
+    if(rc < 0) break;
+  }
+
+  for(w = r.worker; w < r.worker + r.workers; w++) {
+    push(w, RELAY_END, 0);
+    push(w, RELAY_STOP, 0);
+  }
+  for(w = r.worker; w < r.worker + r.workers; w++) {
+    pthread_join(w->thread, NULL);
+    if(w->error) rc = -1;
+    uploader_rollover(&w->u);
+    if(proto->verbose)
+      printf("Worker %2d: lines %u parsed %u duplicates %u sent %d bytes\n", w->index,
+        w->u.lines, w->u.parsed, w->u.duplicates, w->u.totalsize);
+    uploader_close(&w->u);
+  }
+  // Workers are gone, the senders send what is left in their rings and stop
+  for(t = r.target; t < r.target + r.targets; t++) {
+    atomic_store(&t->stop, 1);
+    if(write(t->wake, &one, sizeof(one)) < 0) rc = -1;
+  }
+  for(t = r.target; t < r.target + r.targets; t++) {
+    pthread_join(t->thread, NULL);
+    if(t->error) rc = -1;
+    if(proto->verbose) printf("Target %2d: sent %llu bytes\n", t->index, (unsigned long long)t->sender.bytes);
+    sender_close(&t->sender);
+    close(t->wake);
+  }
+  if(proto->verbose) printf("Relay: %u lines, %u stations connected at exit, %u refused\n", r.lines, r.connections, r.refused);
+
+  for(i = 0; i < RELAY_CONNS; i++)
+    if((c = pool_item(&r.conns, i))->fd >= 0) close(c->fd);
+  if(proto->dedup_name == NULL) shm_unlink(dedup);
+  close(r.listen);
+  close(r.slot);
+  close(r.signal);
+  close(r.epfd);
+  arena_free(&r.arena);
+  return rc;
+}
@@ -0,0 +1,36 @@
+/* Central relay for many receiving stations.
+   Remote stations stream decode lines over TCP, one connection each.
+   The acceptor thread splits the streams into lines and hands each to
+   the worker thread that owns its band, so every call on a band meets
+   the same worker however many stations hear it. Each worker is a
+   complete uploader with its own batch and duplicate check, and hands
+   its datagrams to the one paced sender thread of its RBN Aggregator.
+   The sender takes a worker's batch whole before it looks at the next,
+   so an aggregator gets one ordered stream of datagrams however many
+   workers feed it; with several targets the workers are spread over
+   them. Duplicates heard by more than one station are sent once.
+   */
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdint.h>
+
+#include "uploader.h"
+
+#define RELAY_CONNS 256           // Stations connected at once
+#define RELAY_WORKERS 16          // Band shards
+#define RELAY_TARGETS 8           // RBN Aggregator instances, one sender thread each
+#define RELAY_RING 1024           // Lines queued per worker, and datagrams from it
+
+struct relay_opts {
+  char *listen_addr;              // [address:]port for station streams
+  int32_t workers;                // Band shards, online CPUs if 0, at least one per target
+  int32_t targets;
+  char *ip[RELAY_TARGETS];
+  uint16_t port[RELAY_TARGETS];
+};
+
+int relay_run(const struct uploader *proto, const struct relay_opts *o);
+
+#endif
@@ -0,0 +1,118 @@
+/* Bounded lock-free single-producer single-consumer ring, see ring.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "ring.h"
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t value) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// The items come from a, which needs arena_size(size * item)
+int ring_init(struct ring *r, struct arena *a, uint32_t size, uint32_t item) {
+  memset(r, 0, sizeof(*r));
+  if(size & (size - 1)) return -1;
+  r->size = size;
+  r->item = item;
+  if((r->data = arena_alloc(a, (size_t)size * item)) == NULL) return -1;
+  return 0;
+}
+
+// Wait until the index no longer holds value. The flag is set before
+// the last check and the other side stores the index before reading
+// the flag, both sequentially consistent, so no wakeup is lost.
+static void wait_change(_Atomic uint32_t *word, _Atomic uint32_t *waiting, uint32_t value) {
+  int spin;
+
+  for(spin = 0; spin < RING_SPIN; spin++) {
+    if(atomic_load_explicit(word, memory_order_acquire) != value) return;
+    if(spin >= RING_SPIN / 2) sched_yield(); // Lets the other side run on a single core
+  }
+
+  atomic_store(waiting, 1);
+  while(atomic_load(word) == value) futex_wait(word, value);
+  atomic_store(waiting, 0);
+}
+
+void ring_push(struct ring *r, const void *item) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed), depth;
+
+  if(tail - r->head_cache == r->size) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if(tail - r->head_cache == r->size) {
+      r->full++; // Backpressure: wait for the consumer
+      wait_change(&r->head, &r->producer_waiting, r->head_cache);
+      r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    }
+  }
+
+  depth = tail - r->head_cache;
+  r->pushes++;
+  r->depth_sum += depth;
+  if(depth > r->depth_max) r->depth_max = depth;
+
+  memcpy(r->data + (size_t)(tail & (r->size - 1)) * r->item, item, r->item);
+  atomic_store(&r->tail, tail + 1);
+  if(atomic_load(&r->consumer_waiting)) futex_wake(&r->tail);
+}
+
+// Never waits: -1 if the ring is full, for a consumer that must not hold up the producer
+int ring_try_push(struct ring *r, const void *item) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  if(tail - r->head_cache == r->size) {
+    r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+    if(tail - r->head_cache == r->size) {
+      r->full++;
+      return -1;
+    }
+  }
+
+  ring_push(r, item);
+  return 0;
+}
+
+void ring_pop(struct ring *r, void *item) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  if(head == r->tail_cache) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if(head == r->tail_cache) {
+      wait_change(&r->tail, &r->consumer_waiting, head);
+      r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    }
+  }
+
+  memcpy(item, r->data + (size_t)(head & (r->size - 1)) * r->item, r->item);
+  atomic_store(&r->head, head + 1);
+  if(atomic_load(&r->producer_waiting)) futex_wake(&r->head);
+}
+
+// Never waits: 0 if the ring is empty, for a consumer serving several rings
+int ring_try_pop(struct ring *r, void *item) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  if(head == r->tail_cache) {
+    r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if(head == r->tail_cache) return 0;
+  }
+
+  ring_pop(r, item);
+  return 1;
+}
+
+// Items waiting, safe to call from any thread
+uint32_t ring_depth(struct ring *r) {
+  return atomic_load_explicit(&r->tail, memory_order_relaxed)
+    - atomic_load_explicit(&r->head, memory_order_relaxed);
+}
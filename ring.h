@@ -0,0 +1,43 @@
+/* Bounded lock-free single-producer single-consumer ring.
+   Fixed size items are copied in and out. A full ring blocks the
+   producer and an empty one the consumer, first spinning briefly,
+   then sleeping on a futex, so backpressure reaches the first stage
+   without polling. Producer and consumer indexes sit on separate
+   cache lines, each side caches the other's index and only rereads it
+   when the ring looks full or empty.
+   */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "alloc.h"
+
+#define RING_SPIN 256         // Polls before sleeping on the futex
+
+struct ring {
+  _Alignas(64) _Atomic uint32_t head;   // Next item to consume
+  _Atomic uint32_t consumer_waiting;
+  uint32_t tail_cache;
+  _Alignas(64) _Atomic uint32_t tail;   // Next item to produce
+  _Atomic uint32_t producer_waiting;
+  uint32_t head_cache;
+  uint64_t pushes;                      // Producer side statistics
+  uint64_t depth_sum;                   // Depth seen by each push, for the mean
+  uint32_t depth_max;
+  uint32_t full;                        // Pushes that found the ring full
+  _Alignas(64) uint32_t size;           // Items, a power of two
+  uint32_t item;                        // Item size in bytes
+  char *data;
+};
+
+int ring_init(struct ring *r, struct arena *a, uint32_t size, uint32_t item);
+void ring_push(struct ring *r, const void *item);
+int ring_try_push(struct ring *r, const void *item);
+void ring_pop(struct ring *r, void *item);
+int ring_try_pop(struct ring *r, void *item);
+uint32_t ring_depth(struct ring *r);
+
+#endif
@@ -0,0 +1,146 @@
+/* Paced UDP output queue, see sender.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "sender.h"
+
+uint64_t monotonic_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The queue comes from a, which needs arena_size(SENDER_QUEUE * sizeof(struct datagram))
+int sender_open(struct sender *s, struct arena *a, const char *ip, uint16_t port, int blocking) {
+  int broadcastPermission = 1; // Socket opt to set permission to broadcast
+
+  memset(s, 0, sizeof(*s));
+  s->blocking = blocking;
+
+  s->sock = -1;
+  if((s->queue = arena_alloc(a, SENDER_QUEUE * sizeof(*s->queue))) == NULL) {
+    fprintf(stderr, "Cannot allocate send queue.\n");
+    return -1;
+  }
+
+  // Create socket for sending datagrams
+  if((s->sock = socket(PF_INET, SOCK_DGRAM | (blocking ? 0 : SOCK_NONBLOCK), IPPROTO_UDP)) < 0) {
+    fprintf(stderr, "Cannot open socket.\n");
+    return -1;
+  }
+
+  // Set socket to allow broadcast
+  if (setsockopt(s->sock, SOL_SOCKET, SO_BROADCAST, (void *) &broadcastPermission,
+      sizeof(broadcastPermission)) < 0) {
+    fprintf(stderr, "Enabling broadcast failed.\n");
+    sender_close(s);
+    return -1;
+  }
+
+  memset(&s->addr, 0, sizeof(s->addr)); // Zero out structure
+  s->addr.sin_family = AF_INET; // Address family
+  s->addr.sin_addr.s_addr = inet_addr(ip); // Broadcast IP address
+  s->addr.sin_port = htons(port); // Broadcast IP port
+
+  return 0;
+}
+
+void sender_close(struct sender *s) {
+  if(s->sock >= 0) close(s->sock);
+  s->sock = -1;
+}
+
+uint32_t sender_pending(const struct sender *s) {
+  return s->tail - s->head;
+}
+
+// Start timing a burst unless one is already running
+void sender_burst_begin(struct sender *s) {
+  if(s->burst_start) return;
+  s->burst_start = monotonic_us();
+  s->burst_head = s->head;
+  s->burst_gaps = s->gaps;
+}
+
+// The running burst is out, an overrun if it took longer than the limit
+void sender_burst_end(struct sender *s) {
+  uint32_t sent = s->head - s->burst_head;
+  uint64_t busy;
+
+  if(!s->burst_start) return;
+  s->burst_us = monotonic_us() - s->burst_start;
+  if(s->burst_limit && s->burst_us > s->burst_limit) s->overruns++;
+  s->burst_start = 0;
+
+  // Time not spent pausing went into sending, smoothed over bursts
+  busy = s->burst_us > s->gaps - s->burst_gaps ? s->burst_us - (s->gaps - s->burst_gaps) : 0;
+  if(sent) s->datagram_us = (3 * (uint64_t)s->datagram_us + busy / sent) / 4;
+}
+
+// Queue a datagram, -1 if the queue is full and it was dropped
+int sender_queue(struct sender *s, const char *data, int32_t size, uint16_t gap) {
+  struct datagram *d;
+
+  if(sender_pending(s) == SENDER_QUEUE && (!s->blocking || sender_flush(s) < 0)) {
+    s->dropped++;
+    return -1;
+  }
+
+  d = &s->queue[s->tail++ % SENDER_QUEUE];
+  d->size = size;
+  d->gap = gap;
+  memcpy(d->data, data, size);
+  return 0;
+}
+
+// Send until the queue is empty, a gap must pass or the socket is full
+int sender_pump(struct sender *s) {
+  struct datagram *d;
+  ssize_t rc;
+
+  while(sender_pending(s)) {
+    if(s->not_before && monotonic_us() < s->not_before) return SENDER_GAP;
+    s->not_before = 0;
+
+    d = &s->queue[s->head % SENDER_QUEUE];
+    rc = sendto(s->sock, d->data, d->size, 0, (struct sockaddr *)&s->addr, sizeof(s->addr));
+    if(rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return SENDER_BLOCKED;
+    if(rc != d->size) {
+      fprintf(stderr, "sendto() sent a different number of bytes than expected.\n");
+      return -1;
+    }
+
+    s->bytes += d->size;
+    s->head++;
+    s->gaps += d->gap;
+    if(d->gap) s->not_before = monotonic_us() + d->gap;
+  }
+
+  return SENDER_IDLE;
+}
+
+// Send everything, sleeping through gaps and waiting for the socket
+int sender_flush(struct sender *s) {
+  struct pollfd p = { s->sock, POLLOUT, 0 };
+  uint64_t now;
+  int rc;
+
+  while((rc = sender_pump(s)) != SENDER_IDLE) {
+    if(rc < 0) return -1;
+    if(rc == SENDER_GAP && (now = monotonic_us()) < s->not_before)
+      (void)usleep((useconds_t)(s->not_before - now));
+    if(rc == SENDER_BLOCKED) (void)poll(&p, 1, 100);
+  }
+
+  return 0;
+}
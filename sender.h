@@ -0,0 +1,60 @@
+/* Paced UDP output queue towards RBN Aggregator.
+   Datagrams are queued with the pause RBNA needs after them and sent
+   by sender_pump(), which never blocks, or sender_flush(), which does.
+   The datagrams of one batch form a burst whose duration is timed,
+   which also tells how long the link takes per datagram.
+   */
+
+#ifndef SENDER_H
+#define SENDER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <netinet/in.h>
+
+#include "wsjtx.h"
+#include "alloc.h"
+
+#define SENDER_QUEUE 1024     // Datagrams waiting to be sent
+
+#define SENDER_IDLE 0         // sender_pump() results
+#define SENDER_GAP 1          // Waiting until not_before
+#define SENDER_BLOCKED 2      // Socket buffer full, wait for writability
+
+struct datagram {
+  uint16_t size;
+  uint16_t gap;               // Microseconds to wait after sending
+  char data[WSJTX_MAX];
+};
+
+struct sender {
+  int sock;
+  int blocking;               // sender_queue() flushes instead of dropping when full
+  struct sockaddr_in addr;
+  struct datagram *queue;
+  uint32_t head;              // Next datagram to send
+  uint32_t tail;              // Next free entry
+  uint64_t not_before;        // CLOCK_MONOTONIC microseconds
+  uint64_t bytes;             // Sent bytes
+  uint32_t dropped;           // Datagrams lost to a full queue
+  uint64_t burst_start;       // CLOCK_MONOTONIC microseconds, 0 between bursts
+  uint64_t burst_limit;       // Longer bursts count as overruns, 0 for no limit
+  uint64_t burst_us;          // Duration of the last burst
+  uint32_t overruns;
+  uint32_t burst_head;        // First datagram of the running burst
+  uint64_t gaps;              // Microseconds of pauses after sent datagrams
+  uint64_t burst_gaps;        // gaps when the running burst started
+  _Atomic uint32_t datagram_us; // Mean time per datagram beyond its pause in recent bursts
+};
+
+int sender_open(struct sender *s, struct arena *a, const char *ip, uint16_t port, int blocking);
+void sender_close(struct sender *s);
+int sender_queue(struct sender *s, const char *data, int32_t size, uint16_t gap);
+int sender_pump(struct sender *s);
+int sender_flush(struct sender *s);
+uint32_t sender_pending(const struct sender *s);
+void sender_burst_begin(struct sender *s);
+void sender_burst_end(struct sender *s);
+uint64_t monotonic_us(void);
+
+#endif
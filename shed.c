@@ -0,0 +1,132 @@
+/* Load shedding, see shed.h */
+
+#include <stdint.h>
+
+#include "shed.h"
+#include "sender.h"
+#include "metrics.h"
+
+#define SHED_STATUS_GAP 1000   // Pause after a status datagram, as uploader_send() queues it
+
+// A datagram with its pause is queued
+void shed_queued(struct shed *s, uint16_t gap, uint32_t datagram_us) {
+  uint64_t now = monotonic_us();
+
+  if(s->drain_at < now) s->drain_at = now;
+  s->drain_at += gap + datagram_us;
+}
+
+// Microseconds until everything queued so far is out
+uint64_t shed_backlog(const struct shed *s) {
+  uint64_t now = monotonic_us();
+
+  return s->drain_at > now ? s->drain_at - now : 0;
+}
+
+// How many of the spots in order fit into allowed microseconds and cap
+// datagrams when sent in that order from base frequency bfreq on, the
+// first keep always do. Spots decoded before oldest are not broadcast.
+static uint32_t fit(const struct batch *b, uint32_t n, int32_t bfreq, uint64_t allowed, uint32_t cap,
+    uint32_t datagram_us, uint32_t keep, uint32_t oldest) {
+  uint64_t t = 0;
+  uint32_t i, k, datagrams = 0;
+
+  for(i = 0; i < n; i++) {
+    k = b->order[i];
+    if(b->time[k] < oldest) continue;
+    if(b->bfreq[k] != bfreq) {
+      t += SHED_STATUS_GAP + datagram_us;
+      datagrams++;
+    }
+    t += datagram_us;
+    datagrams++;
+    bfreq = b->bfreq[k];
+    if(i >= keep && (t > allowed || datagrams > cap)) return i;
+  }
+
+  return n;
+}
+
+// Put the spots from first on that are not shed into b->order, newest
+// slot first, first heard calls ahead within a slot, else in arrival
+// order. Returns their count.
+static uint32_t order_fresh(struct batch *b, uint32_t first) {
+  uint32_t i, m = 0;
+
+  for(i = first; i < b->count; i++) {
+    if(b->flags[i] & SPOT_SHED) continue;
+    b->key[m] = (uint64_t)(UINT32_MAX - b->slot[i] / SLOT_SECONDS) << 1 | !(b->flags[i] & SPOT_FIRST);
+    b->order[m++] = i;
+  }
+  batch_sort_keys(b, m);
+  return m;
+}
+
+// Shed all but the strongest spot of each call and band in slots
+// before newest, the survivor keeps a first heard flag. Spots too old
+// to broadcast stay for the archive.
+static void collapse(struct shed *s, struct batch *b, uint32_t first, uint32_t newest, uint32_t oldest) {
+  uint32_t i, k, m = 0, best = 0;
+
+  for(i = first; i < b->count; i++) {
+    if(b->slot[i] >= newest || b->time[i] < oldest) continue;
+    b->key[m] = (uint64_t)b->band[i] << 48 | (uint64_t)b->call[i] << 16 | (uint16_t)(0x7fff - b->snr[i]);
+    b->order[m++] = i;
+  }
+  batch_sort_keys(b, m);
+
+  for(i = 0; i < m; i++) {
+    k = b->order[i];
+    if(!i || b->key[i] >> 16 != b->key[i - 1] >> 16) {
+      best = k;
+      continue;
+    }
+    b->flags[best] |= b->flags[k] & SPOT_FIRST;
+    b->flags[k] |= SPOT_SHED;
+    s->collapsed++;
+  }
+}
+
+/* Plan sending the spots of b from first on with allowed microseconds
+   and cap datagrams left before the backlog passes its threshold,
+   spots decoded before oldest cost nothing. -1 if they fit as they
+   are, else the spots to send are in b->order in that order, the count
+   is returned and the rest carry SPOT_SHED. Uses the sort buffers of
+   b, batch_sort() rebuilds them. */
+int32_t shed_plan(struct shed *s, struct batch *b, uint32_t first, int32_t bfreq, uint64_t allowed, uint32_t cap,
+    uint32_t datagram_us, uint32_t oldest) {
+  uint32_t i, n = b->count - first, newest = 0, fresh = 0, m, fits;
+
+  for(i = 0; i < n; i++) b->order[i] = first + i;
+  if(fit(b, n, bfreq, allowed, cap, datagram_us, 0, oldest) == n) return -1;
+  s->batches++;
+
+  for(i = first; i < b->count; i++) {
+    if(b->slot[i] > newest) fresh = 0;
+    if(b->slot[i] >= newest) {
+      newest = b->slot[i];
+      fresh++;
+    }
+  }
+
+  // Fresh spots first, then older ones collapsed, then the oldest dropped
+  m = order_fresh(b, first);
+  if((fits = fit(b, m, bfreq, allowed, cap, datagram_us, fresh, oldest)) < m) {
+    collapse(s, b, first, newest, oldest);
+    m = order_fresh(b, first);
+    fits = fit(b, m, bfreq, allowed, cap, datagram_us, fresh, oldest);
+  }
+
+  for(i = fits; i < m; i++) b->flags[b->order[i]] |= SPOT_SHED;
+  s->dropped += m - fits;
+  s->deferred += fits - fresh;
+  return fits;
+}
+
+void shed_report(const struct shed *s) {
+  metrics_set("rbn_backlog_seconds", shed_backlog(s) / 1e6);
+  metrics_set("rbn_shed_batches_total", s->batches);
+  metrics_set("rbn_shed_spots_total{action=\"deferred\"}", s->deferred);
+  metrics_set("rbn_shed_spots_total{action=\"collapsed\"}", s->collapsed);
+  metrics_set("rbn_shed_spots_total{action=\"dropped\"}", s->dropped);
+}
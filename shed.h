@@ -0,0 +1,34 @@
+/* Load shedding when the send backlog grows beyond a threshold.
+   The uploader keeps a model of when the datagrams it has queued so
+   far will be out: each adds its pause and the time the sender took
+   per datagram in recent bursts. When that backlog plus the batch
+   about to be queued exceeds the threshold, the batch gives way in
+   steps until it fits: the newest slot goes out first with the older
+   slots behind it, older slots collapse to the strongest spot of each
+   call per band, and finally the spots of the oldest slots are left
+   out. The newest slot is never shed. Every step is counted, so a
+   congested link shows up as shed spots instead of silently stale ones.
+   */
+
+#ifndef SHED_H
+#define SHED_H
+
+#include <stdint.h>
+
+#include "batch.h"
+
+struct shed {
+  uint64_t drain_at;          // CLOCK_MONOTONIC microseconds when everything queued is out
+  uint32_t batches;           // Batches that did not fit
+  uint32_t deferred;          // Spots of older slots sent behind the newest one
+  uint32_t collapsed;         // Weaker repeats of a call on a band in older slots
+  uint32_t dropped;           // Spots of the oldest slots left out
+};
+
+void shed_queued(struct shed *s, uint16_t gap, uint32_t datagram_us);
+uint64_t shed_backlog(const struct shed *s);
+int32_t shed_plan(struct shed *s, struct batch *b, uint32_t first, int32_t bfreq, uint64_t allowed, uint32_t cap,
+  uint32_t datagram_us, uint32_t oldest);
+void shed_report(const struct shed *s);
+
+#endif
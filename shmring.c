@@ -0,0 +1,163 @@
+/* Shared memory ring of binary decodes, see shmring.h */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shmring.h"
+
+#define SHMRING_MAGIC 0x52424e52 // "RBNR"
+
+struct shm_ring {
+  _Atomic uint32_t magic;         // Set last by the creator
+  uint32_t records;
+  uint32_t record;                // Record size, both sides must agree
+  _Atomic uint32_t dropped;       // Records the producer found no room for
+  _Alignas(64) _Atomic uint32_t head;   // Next record to consume
+  _Atomic uint32_t consumer_waiting;
+  _Alignas(64) _Atomic uint32_t tail;   // Next record to produce
+  _Alignas(64) struct shm_record record_data[SHMRING_RECORDS];
+};
+
+// Shared futexes, the two sides are different processes
+static void futex_wait(_Atomic uint32_t *addr, uint32_t value) {
+  syscall(SYS_futex, addr, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Map the ring, creating it if this side comes first
+int shmring_open(struct shmring *r, const char *name) {
+  struct stat st;
+  char path[64];
+  int fd, i, created = 0;
+  void *p;
+
+  memset(r, 0, sizeof(*r));
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+
+  if((fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666)) >= 0) {
+    created = 1;
+    (void)fchmod(fd, 0666); // Decoder and uploader may run as different users
+    if(ftruncate(fd, sizeof(struct shm_ring)) < 0) goto fail;
+  }
+  else {
+    if(errno != EEXIST || (fd = shm_open(path, O_RDWR, 0)) < 0) goto fail;
+    // Creator may still be sizing the segment
+    for(i = 0; i < 1000; i++) {
+      if(fstat(fd, &st) < 0) goto fail;
+      if(st.st_size >= (off_t)sizeof(struct shm_ring)) break;
+      usleep(1000);
+    }
+    if(i == 1000) {
+      fprintf(stderr, "Shared memory segment %s is not a spot ring.\n", path);
+      close(fd);
+      return -1;
+    }
+  }
+
+  if((p = mmap(NULL, sizeof(struct shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) goto fail;
+  close(fd);
+  fd = -1;
+  r->ring = p;
+
+  if(created) {
+    r->ring->records = SHMRING_RECORDS;
+    r->ring->record = sizeof(struct shm_record);
+    atomic_store_explicit(&r->ring->magic, SHMRING_MAGIC, memory_order_release);
+  }
+  else {
+    for(i = 0; i < 1000; i++) {
+      if(atomic_load_explicit(&r->ring->magic, memory_order_acquire) == SHMRING_MAGIC) break;
+      usleep(1000);
+    }
+    if(i == 1000 || r->ring->records != SHMRING_RECORDS || r->ring->record != sizeof(struct shm_record)) {
+      fprintf(stderr, "Shared memory segment %s is not a spot ring.\n", path);
+      shmring_close(r);
+      return -1;
+    }
+  }
+
+  r->head_cache = atomic_load(&r->ring->head);
+  r->tail_cache = atomic_load(&r->ring->tail);
+  return 0;
+
+fail:
+  fprintf(stderr, "Cannot open shared memory segment %s: %s.\n", path, strerror(errno));
+  if(fd >= 0) close(fd);
+  if(created) shm_unlink(path);
+  return -1;
+}
+
+void shmring_close(struct shmring *r) {
+  if(r->ring != NULL) munmap(r->ring, sizeof(*r->ring));
+  memset(r, 0, sizeof(*r));
+}
+
+// Producer: append a record, -1 and counted as dropped if the ring is full
+int shmring_push(struct shmring *r, const struct shm_record *rec) {
+  struct shm_ring *s = r->ring;
+  uint32_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+
+  if(tail - r->head_cache == SHMRING_RECORDS) {
+    r->head_cache = atomic_load_explicit(&s->head, memory_order_acquire);
+    if(tail - r->head_cache == SHMRING_RECORDS) {
+      atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+      return -1;
+    }
+  }
+
+  s->record_data[tail & (SHMRING_RECORDS - 1)] = *rec;
+  atomic_store(&s->tail, tail + 1);
+  if(atomic_load(&s->consumer_waiting)) futex_wake(&s->tail);
+  return 0;
+}
+
+// Consumer: take the oldest record, 0 if the ring is empty
+int shmring_pop(struct shmring *r, struct shm_record *rec) {
+  struct shm_ring *s = r->ring;
+  uint32_t head = atomic_load_explicit(&s->head, memory_order_relaxed);
+
+  if(head == r->tail_cache) {
+    r->tail_cache = atomic_load_explicit(&s->tail, memory_order_acquire);
+    if(head == r->tail_cache) return 0;
+  }
+
+  *rec = s->record_data[head & (SHMRING_RECORDS - 1)];
+  atomic_store_explicit(&s->head, head + 1, memory_order_release);
+  return 1;
+}
+
+// Consumer: sleep while the producer index is still seen and return
+// it, unchanged after shmring_wake() or a spurious wakeup. The flag is
+// set before the last check and the producer stores the index before
+// reading the flag, so no wakeup is lost.
+uint32_t shmring_wait(struct shmring *r, uint32_t seen) {
+  struct shm_ring *s = r->ring;
+  uint32_t tail;
+
+  atomic_store(&s->consumer_waiting, 1);
+  if((tail = atomic_load(&s->tail)) == seen) {
+    futex_wait(&s->tail, seen);
+    tail = atomic_load(&s->tail);
+  }
+  atomic_store(&s->consumer_waiting, 0);
+  return tail;
+}
+
+// Wake a consumer sleeping in shmring_wait(), to make it look again
+void shmring_wake(struct shmring *r) {
+  futex_wake(&r->ring->tail);
+}
+
+uint32_t shmring_dropped(const struct shmring *r) {
+  return atomic_load_explicit(&r->ring->dropped, memory_order_relaxed);
+}
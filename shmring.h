@@ -0,0 +1,45 @@
+/* Shared memory ring of binary decodes from a decoder process.
+   A decoder on the same host writes fixed size spot records into a
+   single-producer single-consumer ring in /dev/shm and the uploader
+   reads them in place of decode lines. Neither side makes a system
+   call per record: the producer only wakes the consumer with a futex
+   on the shared tail index when the consumer said it is about to
+   sleep. A full ring drops records rather than stall the decoder.
+   */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SHMRING_RECORDS 4096      // Records in the ring, a power of two
+
+struct shm_record {
+  uint64_t stamp;                 // CLOCK_MONOTONIC ns when written, for latency measurements
+  uint32_t time;                  // Decode time, seconds since the epoch UTC
+  int32_t freq;                   // Receive frequency in Hz, dial plus audio offset
+  double sync;
+  double dt;                      // Timing error in seconds
+  int16_t snr;
+  char call[14];                  // NUL terminated
+  char grid[6];                   // NUL terminated, empty if unknown
+};
+
+struct shm_ring;
+
+struct shmring {
+  struct shm_ring *ring;
+  uint32_t head_cache;            // Producer's copy of the consumer index
+  uint32_t tail_cache;            // Consumer's copy of the producer index
+};
+
+int shmring_open(struct shmring *r, const char *name);
+void shmring_close(struct shmring *r);
+int shmring_push(struct shmring *r, const struct shm_record *rec);
+int shmring_pop(struct shmring *r, struct shm_record *rec);
+uint32_t shmring_wait(struct shmring *r, uint32_t seen);
+void shmring_wake(struct shmring *r);
+uint32_t shmring_dropped(const struct shmring *r);
+
+#endif
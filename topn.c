@@ -0,0 +1,204 @@
+/* Strongest stations per band and hour, see topn.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#include "topn.h"
+
+#define TOPN_MAGIC 0x52424e54 // "RBNT"
+#define TOPN_VERSION 1
+
+struct topn_heap {
+  uint32_t count;
+  struct topn_entry entry[TOPN]; // Min-heap on snr, weakest at 0
+};
+
+struct topn_file {
+  uint32_t magic;
+  uint32_t version;
+  int32_t base[BANDS];           // Base frequency each row belongs to
+  uint32_t hour[TOPN_HOURS];     // Hours since the epoch, 0 if empty
+  struct topn_heap heap[TOPN_HOURS][BANDS];
+};
+
+int topn_open(struct topn *t, const char *path, const struct config *c) {
+  struct topn_file *f;
+  int32_t fd;
+
+  t->file = NULL;
+
+  if((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+    fprintf(stderr, "Cannot open top stations file %s.\n", path);
+    return -1;
+  }
+
+  // Held while the file is mapped, so a second uploader must not wait for it
+  if(flock(fd, LOCK_EX | LOCK_NB) < 0) {
+    fprintf(stderr, "Top stations file %s is in use by another uploader.\n", path);
+    close(fd);
+    return -1;
+  }
+
+  if(ftruncate(fd, sizeof(*f)) < 0) {
+    fprintf(stderr, "Cannot open top stations file %s.\n", path);
+    close(fd);
+    return -1;
+  }
+
+  f = mmap(NULL, sizeof(*f), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(f == MAP_FAILED) {
+    fprintf(stderr, "Cannot map top stations file %s.\n", path);
+    return -1;
+  }
+
+  if(f->magic != TOPN_MAGIC || f->version != TOPN_VERSION) {
+    memset(f, 0, sizeof(*f));
+    f->magic = TOPN_MAGIC;
+    f->version = TOPN_VERSION;
+  }
+
+  t->file = f;
+  topn_rebind(t, c);
+  return 0;
+}
+
+// Rows of bands whose base frequency changed start over
+void topn_rebind(struct topn *t, const struct config *c) {
+  struct topn_file *f = t->file;
+  int32_t b, i, base;
+
+  for(b = 0; b < BANDS; b++) {
+    base = b < c->bands ? c->base[b] : 0;
+    if(f->base[b] == base) continue;
+    f->base[b] = base;
+    for(i = 0; i < TOPN_HOURS; i++) memset(&f->heap[i][b], 0, sizeof(f->heap[i][b]));
+  }
+}
+
+void topn_close(struct topn *t) {
+  if(t->file == NULL) return;
+  munmap(t->file, sizeof(*t->file));
+  t->file = NULL;
+}
+
+size_t topn_memory(const struct topn *t) {
+  return t->file != NULL ? sizeof(*t->file) : 0;
+}
+
+static void sift_down(struct topn_heap *h, uint32_t i) {
+  struct topn_entry e = h->entry[i];
+  uint32_t child;
+
+  while((child = 2 * i + 1) < h->count) {
+    if(child + 1 < h->count && h->entry[child + 1].snr < h->entry[child].snr) child++;
+    if(e.snr <= h->entry[child].snr) break;
+    h->entry[i] = h->entry[child];
+    i = child;
+  }
+  h->entry[i] = e;
+}
+
+static void sift_up(struct topn_heap *h, uint32_t i) {
+  struct topn_entry e = h->entry[i];
+
+  while(i > 0 && h->entry[(i - 1) / 2].snr > e.snr) {
+    h->entry[i] = h->entry[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->entry[i] = e;
+}
+
+void topn_add(struct topn *t, uint32_t band, uint32_t slot, const char *call, uint32_t hash, int32_t snr) {
+  struct topn_file *f = t->file;
+  uint32_t hour = slot / 3600, r = hour % TOPN_HOURS, i;
+  struct topn_heap *h;
+  struct topn_entry *e;
+
+  if(f->hour[r] != hour) {
+    if(f->hour[r] > hour) return; // Older than the ring reaches
+    memset(f->heap[r], 0, sizeof(f->heap[r]));
+    f->hour[r] = hour;
+  }
+
+  h = &f->heap[r][band];
+
+  // A call already present only moves when it got stronger
+  for(i = 0; i < h->count; i++) {
+    e = &h->entry[i];
+    if(e->hash != hash || strcmp(e->call, call) != 0) continue;
+    if(snr > e->snr) {
+      e->snr = snr;
+      sift_down(h, i);
+    }
+    return;
+  }
+
+  if(h->count == TOPN) {
+    if(snr <= h->entry[0].snr) return;
+    i = 0;
+  }
+  else i = h->count++;
+
+  e = &h->entry[i];
+  e->hash = hash;
+  e->snr = snr;
+  snprintf(e->call, sizeof(e->call), "%s", call);
+  if(i == 0 && h->count == TOPN) sift_down(h, 0);
+  else sift_up(h, i);
+}
+
+static int stronger(const void *a, const void *b) {
+  return ((const struct topn_entry *)b)->snr - ((const struct topn_entry *)a)->snr;
+}
+
+// hour,band,rank,call,snr for every hour in the ring, oldest first
+int topn_dump(const struct topn *t, const char *path) {
+  const struct topn_file *f = t->file;
+  struct topn_entry sorted[TOPN];
+  uint32_t n, i, b, k, last = 0, next;
+  char tmp[256], stamp[24];
+  struct tm tm;
+  time_t s;
+  FILE *fp;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  if((fp = fopen(tmp, "w")) == NULL) {
+    fprintf(stderr, "Cannot write top stations dump %s.\n", tmp);
+    return -1;
+  }
+
+  fprintf(fp, "hour,band,rank,call,snr\n");
+
+  for(n = 0; n < TOPN_HOURS; n++) {
+    next = 0;
+    for(i = 0; i < TOPN_HOURS; i++)
+      if(f->hour[i] > last && (next == 0 || f->hour[i] < f->hour[next - 1])) next = i + 1;
+    if(next == 0) break;
+    i = next - 1;
+    last = f->hour[i];
+
+    s = (time_t)last * 3600;
+    gmtime_r(&s, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:00Z", &tm);
+    for(b = 0; b < BANDS; b++) {
+      memcpy(sorted, f->heap[i][b].entry, f->heap[i][b].count * sizeof(sorted[0]));
+      qsort(sorted, f->heap[i][b].count, sizeof(sorted[0]), stronger);
+      for(k = 0; k < f->heap[i][b].count; k++)
+        fprintf(fp, "%s,%d,%u,%s,%d\n", stamp, f->base[b], k + 1, sorted[k].call, sorted[k].snr);
+    }
+  }
+
+  if(fclose(fp) != 0 || rename(tmp, path) != 0) {
+    fprintf(stderr, "Cannot write top stations dump %s.\n", path);
+    return -1;
+  }
+
+  return 0;
+}
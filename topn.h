@@ -0,0 +1,38 @@
+/* Strongest stations per band and hour.
+   Each (hour, band) keeps a bounded min-heap of the TOPN strongest
+   calls by SNR, one entry per call. The heaps live in a memory mapped
+   state file holding the last TOPN_HOURS hours, so the report survives
+   between runs and needs no archive scans.
+   */
+
+#ifndef TOPN_H
+#define TOPN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "config.h"
+
+#define TOPN 10
+#define TOPN_HOURS 24
+
+struct topn_entry {
+  uint32_t hash;          // Low word of intern_hash64() of call, stable across runs
+  int16_t snr;
+  char call[14];
+};
+
+struct topn_file;
+
+struct topn {
+  struct topn_file *file;
+};
+
+int topn_open(struct topn *t, const char *path, const struct config *c);
+void topn_rebind(struct topn *t, const struct config *c);
+void topn_close(struct topn *t);
+size_t topn_memory(const struct topn *t);
+void topn_add(struct topn *t, uint32_t band, uint32_t slot, const char *call, uint32_t hash, int32_t snr);
+int topn_dump(const struct topn *t, const char *path);
+
+#endif
@@ -0,0 +1,656 @@
+/* Decode line to RBN Aggregator datagram pipeline, see uploader.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "uploader.h"
+#include "metrics.h"
+#include "wsjtx.h"
+
+static int32_t read_int(char **pointer, int32_t *value) {
+  char *start = *pointer;
+  *value = strtol(start, pointer, 10);
+  return start != *pointer;
+}
+
+static int32_t read_dbl(char **pointer, double *value) {
+  char *start = *pointer;
+  *value = strtod(start, pointer);
+  return start != *pointer;
+}
+
+static int32_t read_time(char **pointer, struct tm *value) {
+  *pointer = strptime(*pointer, "%y%m%d %H%M%S", value);
+  return *pointer != NULL;
+}
+
+// Lower of a limit and a size, the size if there is no limit
+static uint32_t budget_cap(uint32_t limit, uint32_t size) {
+  return limit && limit < size ? limit : size;
+}
+
+// Spots a batch may hold: each may bring a new call, and the call table
+// keeps up to three batches worth of calls before it is emptied
+static uint32_t budget_spots(const struct uploader *u) {
+  return u->budget.limit[BUDGET_SPOTS] / (batch_spot_size() + 4 * INTERN_CALL_BYTES);
+}
+
+// Delta slots of the first heard set: half its share, the other half
+// holds the index into the file
+static uint32_t budget_first(const struct uploader *u) {
+  uint64_t slots = u->budget.limit[BUDGET_FIRST] / 2 / (2 * sizeof(uint64_t)), power = 256;
+
+  while(2 * power <= slots && power < 1u << 30) power *= 2;
+  return power;
+}
+
+static uint32_t budget_sketches(const struct uploader *u) {
+  uint64_t count = u->budget.limit[BUDGET_SKETCHES] / sizeof(struct hll_record);
+
+  return count > UINT32_MAX ? UINT32_MAX : count ? count : 1;
+}
+
+// Charge what is fixed once the uploader is open to the budget and
+// shrink the start sizes and the sketch window to the shares left
+static int plan_budget(struct uploader *u) {
+  uint32_t weight[BUDGET_PARTS] = { 0, 2, u->first_path != NULL, u->heard_path != NULL }, spots, days;
+  uint64_t fixed = budget_rss() + u->reserved + u->arena.size
+    + (u->dedup_name != NULL ? u->dedup.length : 0)
+    + (u->activity_path != NULL ? activity_memory(&u->activity) : 0)
+    + (u->top_path != NULL ? topn_memory(&u->top) : 0);
+
+  if(budget_plan(&u->budget, u->config->memory, fixed, weight) < 0) return -1;
+
+  spots = budget_spots(u);
+  u->config->spots = budget_cap(spots, u->config->spots);
+  u->config->calls = budget_cap(3 * spots, u->config->calls);
+  days = budget_sketches(u) / u->config->bands; // Sketches per band, one is the day being started
+  if(u->heard_path != NULL) u->heard_days = days > HLL_DAYS ? HLL_DAYS : days > 1 ? days - 1 : 1;
+
+  if(u->verbose)
+    printf("Memory budget: %llu bytes, %llu fixed, %u spots per batch, %u sketch days\n",
+      (unsigned long long)u->budget.total, (unsigned long long)fixed, spots, u->heard_days);
+  return 0;
+}
+
+int uploader_open(struct uploader *u, const char *ip, uint16_t port, int blocking) {
+  memset(u->stats, 0, sizeof(u->stats));
+  u->next = 0;
+  u->emit = NULL;
+  u->entity_seen = NULL;
+  u->prevbfreq = 0;
+  u->totalsize = 0;
+  u->last_day = 0;
+  u->deadline = 0;
+  u->lines = u->parsed = u->duplicates = u->firsts = u->band_slots = u->entities = u->late = 0;
+  memset(&u->shed, 0, sizeof(u->shed));
+  if(u->period <= 0) u->period = SLOT_SECONDS;
+  u->config = &u->configs[0];
+  u->encode = u->config;
+  u->reload_pending = 0;
+
+  // Everything uploader_close() releases starts out released, so a
+  // failed open can undo the steps that went through
+  memset(&u->arena, 0, sizeof(u->arena));
+  memset(&u->dedup, 0, sizeof(u->dedup));
+  memset(&u->cty, 0, sizeof(u->cty));
+  memset(&u->first, 0, sizeof(u->first));
+  memset(&u->calls, 0, sizeof(u->calls));
+  memset(&u->spots, 0, sizeof(u->spots));
+  u->first.fd = u->fresh.fd = u->sender.sock = u->psk.sock = u->cluster.wake = -1;
+  u->activity.file = NULL;
+  u->top.file = NULL;
+  hll_init(&u->heard);
+
+  dtmon_init(&u->clock, u->config->clock_warn);
+
+  if(fresh_open(&u->fresh, u->archive_path) < 0)
+    goto fail;
+
+  if(u->dedup_name != NULL && dedup_open(&u->dedup, u->dedup_name, DEDUP_ENTRIES) < 0)
+    goto fail;
+
+  if(u->activity_path != NULL && activity_open(&u->activity, u->activity_path, u->config) < 0)
+    goto fail;
+
+  if(u->top_path != NULL && topn_open(&u->top, u->top_path, u->config) < 0)
+    goto fail;
+
+  if(u->cty_path != NULL && cty_load(&u->cty, u->cty_path) < 0)
+    goto fail;
+
+  if(arena_init(&u->arena, arena_size(SENDER_QUEUE * sizeof(struct datagram))
+      + (u->cty_path != NULL ? arena_size(u->cty.entities) : 0)
+      + (u->psk_target != NULL ? psk_memory() : 0)
+      + (u->cluster_addr != NULL ? cluster_memory() : 0)) < 0)
+    goto fail;
+
+  if(u->cty_path != NULL) u->entity_seen = arena_alloc(&u->arena, u->cty.entities);
+
+  if(sender_open(&u->sender, &u->arena, ip, port, blocking) < 0)
+    goto fail;
+
+  if((u->psk_target != NULL || u->cluster_addr != NULL) && !u->config->receiver[0]) {
+    fprintf(stderr, "PSK Reporter and the DX cluster need a receiver line in the config file.\n");
+    goto fail;
+  }
+  if(u->psk_target != NULL && psk_open(&u->psk, &u->arena, u->psk_target, u->config->receiver, u->config->locator,
+      u->config->antenna, u->mode != NULL ? u->mode : "FT8") < 0)
+    goto fail;
+
+  if(u->cluster_addr != NULL && cluster_open(&u->cluster, &u->arena, u->cluster_addr, u->config->receiver,
+      u->mode != NULL ? u->mode : "FT8") < 0)
+    goto fail;
+
+  // Everything fixed is in place, the budget shares out the rest
+  memset(&u->budget, 0, sizeof(u->budget));
+  u->heard_days = HLL_DAYS;
+  if(u->config->memory && plan_budget(u) < 0)
+    goto fail;
+
+  // Tables sized from the config up front, after the first slots nothing grows
+  if(intern_init(&u->calls, u->config->calls) < 0 || batch_init(&u->spots, u->config->spots) < 0) {
+    fprintf(stderr, "Cannot allocate call sign table.\n");
+    goto fail;
+  }
+  u->spots.limit = u->budget.total ? budget_spots(u) : 0;
+  u->calls.limit = u->budget.total ? u->config->calls + u->spots.limit : 0; // One full batch past the reset
+
+  if(u->first_path != NULL && heard_open(&u->first, u->first_path,
+      budget_cap(u->budget.total ? budget_first(u) / 2 : 0, u->config->calls), u->budget.total ? budget_first(u) : 0) < 0)
+    goto fail;
+
+  // Every band for the days kept plus the one being started
+  hll_init(&u->heard);
+  u->heard.limit = u->budget.total ? budget_sketches(u) : 0;
+  if(u->heard_path != NULL && (hll_load(&u->heard, u->heard_path) < 0
+      || hll_reserve(&u->heard, budget_cap(u->heard.limit, (u->heard_days + 1) * u->config->bands)) < 0))
+    goto fail;
+
+  return 0;
+
+fail:
+  uploader_close(u);
+  return -1;
+}
+
+void uploader_close(struct uploader *u) {
+  if(u->activity_path != NULL) activity_close(&u->activity);
+  if(u->top_path != NULL) topn_close(&u->top);
+  if(u->first_path != NULL) heard_close(&u->first);
+  if(u->cty_path != NULL) cty_free(&u->cty);
+  if(u->dedup_name != NULL) dedup_close(&u->dedup);
+  if(u->psk_target != NULL) psk_close(&u->psk);
+  if(u->cluster_addr != NULL) cluster_close(&u->cluster);
+  fresh_close(&u->fresh);
+  hll_free(&u->heard);
+  batch_free(&u->spots);
+  intern_free(&u->calls);
+  sender_close(&u->sender);
+  arena_free(&u->arena);
+}
+
+// Key of the slot holding time t, its start rounded down to the second
+// as FT4 slots start on half seconds
+uint32_t uploader_slot(const struct uploader *u, double t) {
+  return (uint32_t)(floor(t / u->period) * u->period);
+}
+
+// Snap a decode's frequency and apply the band's filter, 1 if it
+// passed and s holds everything but the call, grid and entity
+int uploader_filter(struct uploader *u, struct spot *s, time_t t, double sync, int32_t snr, double dt, int32_t freq) {
+  const struct config *c = atomic_load_explicit(&u->config, memory_order_acquire);
+  int32_t bfreq, rc, band;
+  uint32_t slot = uploader_slot(u, t);
+
+  dtmon_add(&u->clock, slot, dt); // Clock health looks at every decode, filtered or not
+
+  band = config_snap(c, freq, &bfreq);
+  rc = filter_check(&c->filter[band], sync, snr, dt);
+  if(rc != FILTER_PASS) {
+    u->stats[band].rejected[rc]++;
+    return 0;
+  }
+
+  s->band = band;
+  s->slot = slot;
+  s->time = t;
+  s->freq = freq;
+  s->bfreq = bfreq;
+  s->snr = snr;
+  s->dt = dt;
+  s->sync = sync;
+  s->flags = 0;
+  return 1;
+}
+
+// Count a filtered spot with its call set, resolve its entity and
+// flag it if the call is new on the band
+void uploader_accept(struct uploader *u, struct spot *s, time_t t) {
+  u->stats[s->band].passed++;
+  s->entity = u->cty_path != NULL ? cty_lookup(&u->cty, s->call)->entity : CTY_NONE;
+
+  // Under a memory budget a full delta is merged into the file early
+  if(u->first_path != NULL && heard_full(&u->first) && heard_save(&u->first, u->first_path) == 0)
+    u->budget.evictions[BUDGET_FIRST]++;
+
+  if(u->first_path != NULL && s->band != BAND_OTHER && heard_first(&u->first, s->bfreq, s->call)) {
+    s->flags |= SPOT_FIRST;
+    u->firsts++;
+    printf("First heard: %s on %d kHz at %02d:%02d:%02d\n", s->call, s->bfreq / 1000,
+      (int)(t / 3600 % 24), (int)(t / 60 % 60), (int)(t % 60));
+  }
+}
+
+// Binary counterpart of uploader_parse() for decoders handing over
+// their decodes directly, 1 if it passed the filters
+int uploader_decode(struct uploader *u, struct spot *s, time_t t, double sync, int32_t snr, double dt, int32_t freq,
+    const char *call, const char *grid) {
+  u->lines++;
+  if(!uploader_filter(u, s, t, sync, snr, dt, freq) || call == NULL || !*call) return 0;
+
+  snprintf(s->call, sizeof(s->call), "%s", call);
+  snprintf(s->grid, sizeof(s->grid), "%s", grid != NULL ? grid : "");
+  uploader_accept(u, s, t);
+  return 1;
+}
+
+// Parse one decode line into s, 1 if it passed the filters. Owns the
+// line counters, filter statistics, clock monitor, cty and heard set.
+int uploader_parse(struct uploader *u, char *line, struct spot *s) {
+  struct tm tm;                     // Time and date of decode
+  double sync, dt;
+  int32_t snr, freq, rc;
+  char *src = line;
+  time_t t;
+
+  u->lines++;
+  s->grid[0] = 0;
+  s->call[0] = 0;
+  memset(&tm, 0, sizeof(tm));
+  rc = read_time(&src, &tm)         // Read date and time
+    && read_dbl(&src, &sync)        // Read sync
+    && read_int(&src, &snr)         // Read snr report
+    && read_dbl(&src, &dt)          // Read timing error
+    && read_int(&src, &freq);       // Read receive frequency
+
+  if(!rc) return 0; // Skip line if parsing failed
+
+  // Rejected decodes skip call extraction and encoding
+  t = timegm(&tm);
+  if(!uploader_filter(u, s, t, sync, snr, dt, freq)) return 0;
+
+  if(!sscanf(src, "%13s %4s", s->call, s->grid)) return 0; // Read call and grid
+
+//    printf("call: %8s grid: %6s sync: %5.1f freq: %8d dt: %4.1f snr: %3d\n",
+//      s->call, s->grid, sync, freq, dt, snr);
+
+  uploader_accept(u, s, t);
+  return 1;
+}
+
+// Append a parsed spot to the batch, -1 if memory ran out
+int uploader_add(struct uploader *u, const struct spot *s) {
+  uint32_t call;
+  int32_t i;
+
+  // Under a memory budget a full batch goes out early instead of growing
+  if(u->spots.limit && u->spots.count == u->spots.limit) {
+    if(uploader_send(u) < 0) return -1;
+    uploader_rollover(u);
+    u->budget.evictions[BUDGET_SPOTS]++;
+  }
+
+  // A resident uploader starts over once a new batch finds the table full
+  if(!u->spots.count && u->calls.count >= u->encode->calls) intern_clear(&u->calls);
+
+  // Later stages work on the id only, a call without one cannot be sent
+  if((call = intern_call(&u->calls, s->call)) == INTERN_NONE) {
+    u->uninterned++;
+    return 0;
+  }
+
+  if((i = batch_add(&u->spots)) < 0) {
+    fprintf(stderr, "Cannot allocate spot batch.\n");
+    return -1;
+  }
+
+  u->parsed++;
+  u->spots.band[i] = s->band;
+  u->spots.slot[i] = s->slot;
+  u->spots.time[i] = s->time;
+  u->spots.freq[i] = s->freq;
+  u->spots.bfreq[i] = s->bfreq;
+  u->spots.snr[i] = s->snr;
+  u->spots.dt[i] = s->dt;
+  u->spots.sync[i] = s->sync;
+  u->spots.call[i] = call;
+  u->spots.flags[i] = s->flags;
+  u->spots.entity[i] = s->entity;
+  batch_set_grid(&u->spots, i, s->grid);
+  return 0;
+}
+
+// Parse one decode line into the batch, -1 only if memory ran out
+int uploader_line(struct uploader *u, char *line) {
+  struct spot s;
+
+  return uploader_parse(u, line, &s) ? uploader_add(u, &s) : 0;
+}
+
+static int emit(struct uploader *u, const char *data, int32_t size, uint16_t gap) {
+  if(u->encode->backlog > 0) shed_queued(&u->shed, gap, u->sender.datagram_us);
+  if(u->emit != NULL) return u->emit(u->emit_ctx, data, size, gap);
+  if(sender_queue(&u->sender, data, size, gap) < 0 && u->sender.blocking) return -1;
+  return 0;
+}
+
+// Queue the datagrams of spot n, a spot past the freshness budget
+// only goes to the local statistics and the archive
+static int send_spot(struct uploader *u, uint32_t n, time_t now) {
+  struct batch *spots = &u->spots;
+  char buffer[WSJTX_MAX], grid[8];
+  struct hll_record *sketch;
+  int32_t bfreq, snr, size, stale;
+  uint64_t hash = intern_id_hash(&u->calls, spots->call[n]); // Counting and duplicate checks key on this
+  const char *call = intern_name(&u->calls, spots->call[n]);  // Only for sinks that carry the text
+
+  bfreq = spots->bfreq[n];
+  snr = spots->snr[n];
+  if(spots->slot[n] < u->deadline) u->late++; // Its slot was already flushed
+  batch_get_grid(spots, n, grid);
+  fresh_age(&u->fresh, now - spots->time[n]);
+  stale = u->encode->max_age && now - spots->time[n] > u->encode->max_age;
+
+  // Another uploader on this host already sent this spot
+  if(!stale && u->dedup_name != NULL && dedup_seen(&u->dedup, hash, bfreq, spots->slot[n], now)) {
+    u->duplicates++;
+    return 0;
+  }
+
+  if(u->activity_path != NULL)
+    activity_add(&u->activity, spots->band[n], spots->slot[n], (uint32_t)hash, snr);
+
+  if(u->top_path != NULL)
+    topn_add(&u->top, spots->band[n], spots->slot[n], call, (uint32_t)hash, snr);
+
+  if(u->heard_path != NULL && spots->band[n] != BAND_OTHER) {
+    if(spots->slot[n] / 86400 > u->last_day) u->last_day = spots->slot[n] / 86400;
+    if((sketch = hll_get(&u->heard, spots->slot[n] / 86400, bfreq)) != NULL) hll_add(sketch, hash);
+  }
+
+  if(stale) {
+    fresh_archive(&u->fresh, spots->time[n], spots->sync[n], snr, spots->dt[n], spots->freq[n], call, grid);
+    return 0;
+  }
+
+  if(u->psk_target != NULL) psk_add(&u->psk, call, hash, spots->freq[n], bfreq, snr, spots->time[n]);
+
+  if(u->cluster_addr != NULL) cluster_spot(&u->cluster, call, grid, spots->freq[n], snr, spots->time[n]);
+
+  // Status datagram only when the base frequency changes, RBNA needs 1ms to digest it
+  if(u->prevbfreq != bfreq) {
+    size = wsjtx_status(buffer, bfreq, call, snr);
+    u->totalsize += size;
+    if(emit(u, buffer, size, 1000) < 0) return -1;
+  }
+
+  u->prevbfreq = bfreq;
+
+  size = wsjtx_decode(buffer, snr, spots->dt[n], spots->freq[n] - bfreq, call, grid);
+  u->totalsize += size;
+  return emit(u, buffer, size, 0);
+}
+
+// Spots to send with the backlog under its threshold, -1 for all in
+// the usual order, else they are in u->spots.order
+static int32_t plan_send(struct uploader *u, time_t now) {
+  const struct config *c = u->encode;
+  uint64_t backlog, limit = c->backlog * 1e6;
+  uint32_t cap = UINT32_MAX;
+
+  if(!(c->backlog > 0) || u->next == u->spots.count) return -1;
+
+  // A full send queue that cannot flush would drop the newest datagrams
+  if(u->emit == NULL && !u->sender.blocking) cap = SENDER_QUEUE - sender_pending(&u->sender);
+  backlog = shed_backlog(&u->shed);
+  return shed_plan(&u->shed, &u->spots, u->next, u->prevbfreq, backlog < limit ? limit - backlog : 0, cap,
+    u->sender.datagram_us, c->max_age ? now - c->max_age : 0);
+}
+
+// Shedding thins the RBN stream only, PSK Reporter batches its spots
+// for minutes and still takes the ones left out
+static void report_shed(struct uploader *u, time_t now) {
+  struct batch *spots = &u->spots;
+  uint32_t n;
+
+  for(n = u->next; n < spots->count; n++)
+    if(spots->flags[n] & SPOT_SHED && !(u->encode->max_age && now - spots->time[n] > u->encode->max_age))
+      psk_add(&u->psk, intern_name(&u->calls, spots->call[n]), intern_id_hash(&u->calls, spots->call[n]),
+        spots->freq[n], spots->bfreq[n], spots->snr[n], spots->time[n]);
+}
+
+// Queue the datagrams of every spot parsed since the last call
+int uploader_send(struct uploader *u) {
+  struct batch *spots = &u->spots;
+  time_t now = time(NULL);
+  int32_t i, planned = plan_send(u, now);
+  uint32_t pass, n, k;
+
+  // Under a backlog newer slots go first, what was shed is left out
+  for(i = 0; i < planned; i++)
+    if(send_spot(u, spots->order[i], now) < 0) return -1;
+  if(planned >= 0 && u->psk_target != NULL) report_shed(u, now);
+
+  // Grouped by band, the status datagram and its pause come once per band
+  if(planned < 0 && u->grouped) batch_sort(spots);
+
+// Send spots in arrival order, first heard calls ahead of the rest
+  for(pass = 0; planned < 0 && pass < 2; pass++)
+  for(k = u->grouped ? 0 : u->next; k < spots->count; k++) {
+    n = u->grouped ? spots->order[k] : k;
+    if(n < u->next || !(spots->flags[n] & SPOT_FIRST) == !pass) continue;
+    if(send_spot(u, n, now) < 0) return -1;
+  }
+
+  if(u->cluster_addr != NULL) cluster_wake(&u->cluster);
+  u->next = spots->count;
+  return 0;
+}
+
+// Fold the sent batch into the run totals and start a new one
+void uploader_rollover(struct uploader *u) {
+  struct batch *spots = &u->spots;
+  uint32_t n, a, b;
+
+  batch_sort(spots); // Group by band and slot with a linear scan
+  for(n = 0; n < spots->count; n++) {
+    a = spots->order[n];
+    b = n ? spots->order[n - 1] : 0;
+    if(!n || spots->band[a] != spots->band[b] || spots->slot[a] != spots->slot[b]) u->band_slots++;
+  }
+
+  if(u->entity_seen != NULL)
+    for(n = 0; n < spots->count; n++)
+      if(spots->entity[n] != CTY_NONE && !u->entity_seen[spots->entity[n]]) {
+        u->entity_seen[spots->entity[n]] = 1;
+        u->entities++;
+      }
+
+  batch_clear(spots);
+  u->next = 0;
+}
+
+// Close the clock statistics of slots before this one and export metrics
+void uploader_tick(struct uploader *u, uint32_t slot) {
+  dtmon_flush(&u->clock, slot);
+  alloc_check(slot);
+  uploader_budget_parse(u);
+  uploader_budget_encode(u);
+  if(u->psk_target != NULL) psk_flush(&u->psk, time(NULL), slot == UINT32_MAX);
+
+  if(u->metrics_path != NULL) {
+    metrics_set("rbn_lines", u->lines);
+    metrics_set("rbn_spots", u->parsed);
+    metrics_set("rbn_sent_bytes", u->totalsize);
+    metrics_set("rbn_duplicates", u->duplicates);
+    metrics_set("rbn_uninterned_spots_total", u->uninterned);
+    metrics_set("rbn_late_spots_total", u->late);
+    metrics_set("rbn_burst_seconds", u->sender.burst_us / 1e6);
+    metrics_set("rbn_burst_overruns_total", u->sender.overruns);
+    metrics_set("rbn_send_dropped_total", u->sender.dropped);
+    if(u->encode->backlog > 0) shed_report(&u->shed);
+    fresh_report(&u->fresh);
+    if(u->psk_target != NULL) psk_report(&u->psk);
+    if(u->cluster_addr != NULL) cluster_report(&u->cluster);
+    metrics_write(u->metrics_path);
+  }
+}
+
+// Memory of the parser's tables against their shares
+void uploader_budget_parse(struct uploader *u) {
+  if(u->budget.total && u->first_path != NULL) budget_report(&u->budget, BUDGET_FIRST, heard_memory(&u->first));
+}
+
+// Memory of the encoder's tables and of the whole process
+void uploader_budget_encode(struct uploader *u) {
+  if(!u->budget.total) return;
+  budget_report(&u->budget, BUDGET_FIXED, u->budget.limit[BUDGET_FIXED]);
+  budget_report(&u->budget, BUDGET_SPOTS, batch_memory(&u->spots) + intern_memory(&u->calls));
+  if(u->heard_path != NULL) {
+    u->budget.evictions[BUDGET_SKETCHES] = u->heard.evicted;
+    budget_report(&u->budget, BUDGET_SKETCHES, (uint64_t)u->heard.size * sizeof(*u->heard.record));
+  }
+  metrics_set("rbn_memory_budget_bytes", u->budget.total);
+  metrics_set("rbn_resident_bytes", budget_rss());
+}
+
+// Write the CSV reports
+void uploader_dump(struct uploader *u) {
+  if(u->activity_path != NULL && u->activity_csv != NULL) activity_dump_csv(&u->activity, u->activity_csv);
+  if(u->top_path != NULL && u->top_dump != NULL) topn_dump(&u->top, u->top_dump);
+}
+
+// Persist the state kept in memory between saves
+void uploader_save(struct uploader *u) {
+  if(u->first_path != NULL) heard_save(&u->first, u->first_path);
+
+  if(u->heard_path != NULL)
+    hll_update(&u->heard, u->heard_path, u->last_day ? u->last_day - u->heard_days + 1 : 0);
+}
+
+void uploader_summary(struct uploader *u) {
+  int32_t i;
+
+  printf("Lines: %d parsed: %u sent: %d bytes\n", u->lines, u->parsed, u->totalsize);
+  printf("Unique calls: %u table memory: %zu bytes\n", u->calls.count, intern_memory(&u->calls));
+  printf("Band slots: %d\n", u->band_slots);
+  if(u->dedup_name != NULL) printf("Duplicates suppressed: %u\n", u->duplicates);
+  if(u->cty_path != NULL) printf("DXCC entities: %d\n", u->entities);
+  for(i = 0; i < BANDS; i++) {
+    if(i >= u->config->bands && i != BAND_OTHER) continue;
+    if(!u->stats[i].passed && !u->stats[i].rejected[FILTER_SYNC]
+        && !u->stats[i].rejected[FILTER_SNR] && !u->stats[i].rejected[FILTER_DT]) continue;
+    printf("Band %8d: passed %u rejected sync %u snr %u dt %u\n",
+      i == BAND_OTHER ? 0 : u->config->base[i], u->stats[i].passed, u->stats[i].rejected[FILTER_SYNC],
+      u->stats[i].rejected[FILTER_SNR], u->stats[i].rejected[FILTER_DT]);
+  }
+
+  if(u->first_path != NULL) printf("First heard: %u\n", u->firsts);
+  if(u->late) printf("Late spots: %u\n", u->late);
+  if(u->uninterned) printf("Spots skipped with the call table full: %u\n", u->uninterned);
+  if(u->psk_target != NULL) printf("PSK Reporter: %u spots in %u packets, %u repeats held back\n", u->psk.spots,
+    u->psk.packets, u->psk.repeats);
+  if(u->cluster_addr != NULL) printf("DX cluster: %u spots, %u dropped, %u slow clients disconnected\n",
+    u->cluster.sent, u->cluster.dropped, u->cluster.slow);
+  if(u->fresh.stale) printf("Stale spots: %u not broadcast, %u archived\n", u->fresh.stale, u->fresh.archived);
+  if(u->sender.dropped) printf("Datagrams lost to a full send queue: %u\n", u->sender.dropped);
+  if(u->shed.batches) printf("Shed batches: %u spots deferred %u collapsed %u dropped %u\n", u->shed.batches,
+    u->shed.deferred, u->shed.collapsed, u->shed.dropped);
+
+  if(u->budget.total) {
+    printf("Memory budget: %llu bytes, resident %llu\n", (unsigned long long)u->budget.total,
+      (unsigned long long)budget_rss());
+    for(i = BUDGET_FIXED + 1; i < BUDGET_PARTS; i++)
+      if(u->budget.limit[i]) printf("Memory %-8s: share %llu bytes, gave way %u times\n", budget_part[i],
+        (unsigned long long)u->budget.limit[i], u->budget.evictions[i]);
+  }
+
+  if(u->heard_path != NULL)
+    for(i = 0; i < (int32_t)u->heard.count; i++)
+      if(u->heard.record[i].day == u->last_day)
+        printf("Band %8d: %.0f distinct calls today\n", u->heard.record[i].base, hll_estimate(&u->heard.record[i]));
+}
+
+// Load the config file again into the spare slot, swapped in by
+// uploader_swap() at the next slot boundary. -1 keeps the old config.
+int uploader_reload(struct uploader *u) {
+  struct config *next = u->config == &u->configs[0] ? &u->configs[1] : &u->configs[0];
+
+  if(u->config_path == NULL) {
+    fprintf(stderr, "No config file to reload.\n");
+    return -1;
+  }
+
+  // The spare copy may still be read until the last swap has passed every stage
+  if(u->reload_pending) {
+    fprintf(stderr, "Reload already pending.\n");
+    return -1;
+  }
+
+  config_default(next);
+  if(config_load(next, u->config_path) < 0) {
+    fprintf(stderr, "Keeping the old config.\n");
+    return -1;
+  }
+
+  // Tables are sized and the budget shared out once at startup
+  next->spots = u->config->spots;
+  next->calls = u->config->calls;
+  next->memory = u->config->memory;
+
+  u->reload_pending = RELOAD_LOADED;
+  return 0;
+}
+
+// Parser side of the swap: band counters follow their base frequency
+// into the new plan, counters of bands no longer in it are dropped
+void uploader_swap_parse(struct uploader *u) {
+  struct config *old = u->config, *next = old == &u->configs[0] ? &u->configs[1] : &u->configs[0];
+  struct filter_stats stats[BANDS];
+  int32_t b, o;
+
+  memset(stats, 0, sizeof(stats));
+  stats[BAND_OTHER] = u->stats[BAND_OTHER];
+  for(b = 0; b < next->bands; b++)
+    for(o = 0; o < old->bands; o++)
+      if(old->base[o] == next->base[b]) {
+        stats[b] = u->stats[o];
+        break;
+      }
+  memcpy(u->stats, stats, sizeof(stats));
+
+  u->clock.threshold = next->clock_warn;
+  atomic_store_explicit(&u->config, next, memory_order_release);
+  if(u->verbose) printf("Config reloaded: %d bands\n", next->bands);
+}
+
+// Encoder side of the swap, after every spot of the old plan was sent
+void uploader_swap_encode(struct uploader *u) {
+  u->encode = atomic_load_explicit(&u->config, memory_order_acquire);
+  if(u->heard_path != NULL && hll_reserve(&u->heard, budget_cap(u->heard.limit, (u->heard_days + 1) * u->encode->bands)) < 0)
+    fprintf(stderr, "Cannot allocate call count sketches.\n");
+  if(u->activity_path != NULL) activity_rebind(&u->activity, u->encode);
+  if(u->top_path != NULL) topn_rebind(&u->top, u->encode);
+}
+
+// Swap in a loaded config between slots, nothing if none is pending
+void uploader_swap(struct uploader *u) {
+  if(u->reload_pending != RELOAD_LOADED) return;
+  uploader_swap_parse(u);
+  uploader_swap_encode(u);
+  u->reload_pending = RELOAD_NONE;
+}
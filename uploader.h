@@ -0,0 +1,137 @@
+/* Decode line to RBN Aggregator datagram pipeline.
+   Holds everything one receiver's uploader keeps between lines: the
+   band plan, the spot batch and every optional subsystem. The one-shot
+   command line and the resident daemon both drive it the same way,
+   uploader_line() for each decode, uploader_send() to queue the
+   datagrams of the spots parsed since the last call. uploader_line()
+   is uploader_parse() and uploader_add(), which the pipeline runs on
+   separate threads; each touches only its own part of the state.
+   A reload loads the new band plan and filters into the spare config
+   and the parser switches to it between slots, RCU style: spots
+   already parsed finish under the config they were parsed with and
+   the old copy is only reused once every stage has passed the swap.
+   */
+
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "intern.h"
+#include "config.h"
+#include "batch.h"
+#include "dedup.h"
+#include "dtmon.h"
+#include "activity.h"
+#include "hll.h"
+#include "heard.h"
+#include "cty.h"
+#include "topn.h"
+#include "sender.h"
+#include "alloc.h"
+#include "budget.h"
+#include "shed.h"
+#include "fresh.h"
+#include "psk.h"
+#include "cluster.h"
+
+enum { RELOAD_NONE, RELOAD_LOADED, RELOAD_SWAPPING }; // uploader reload_pending
+
+// One parsed decode on its way from the parser to the batch
+struct spot {
+  uint8_t band;
+  uint8_t flags;
+  uint16_t entity;
+  uint32_t slot;
+  uint32_t time;                    // Decode timestamp
+  int32_t freq, bfreq;
+  int16_t snr;
+  float sync;
+  double dt;
+  char call[14];
+  char grid[6];
+};
+
+// Datagram output, sender_queue() on u->sender when NULL
+typedef int (*uploader_emit)(void *ctx, const char *data, int32_t size, uint16_t gap);
+
+struct uploader {
+  // Options, set before uploader_open(), NULL if unused
+  char *dedup_name;                 // Share duplicate table with other uploaders
+  char *metrics_path;               // Prometheus text file
+  char *activity_path, *activity_csv;
+  char *heard_path;                 // Distinct calls per band and day
+  char *first_path;                 // Every call ever heard per band
+  char *cty_path;                   // DXCC prefixes
+  char *top_path, *top_dump;        // Strongest calls per band and hour
+  char *config_path;                // Reread by uploader_reload()
+  char *archive_path;               // Spots too old to broadcast
+  char *psk_target;                 // PSK Reporter host[:port]
+  char *mode;                       // Mode reported to PSK Reporter and cluster clients, FT8 if NULL
+  double period;                    // Slot length in seconds, SLOT_SECONDS if 0
+  char *cluster_addr;               // [address:]port of the local DX cluster
+  int32_t verbose;
+  int32_t grouped;                  // Send each batch by band, one status datagram per band
+  uint64_t reserved;                // Bytes the caller adds after uploader_open(), charged to the budget
+  struct config configs[2];         // Active and spare band plan, configs[0] at startup
+  struct config *_Atomic config;    // Band plan and quality filters in use
+  const struct config *encode;      // Config of the spots being encoded, follows config at uploader_swap_encode()
+  _Atomic int32_t reload_pending;   // RELOAD_NONE once the spare config is unused
+
+  struct arena arena;               // Send queue and entity table
+  struct filter_stats stats[BANDS]; // Pass and reject counters per band
+  struct intern calls;              // Call sign interning table
+  struct batch spots;               // Spots parsed since the last rollover
+  uint32_t next;                    // First spot not yet sent
+  struct sender sender;
+  uploader_emit emit;
+  void *emit_ctx;
+  struct dedup dedup;
+  struct dtmon clock;               // Decode timing statistics per slot
+  struct activity activity;
+  struct hll_set heard;
+  struct heard first;
+  struct cty cty;
+  struct topn top;
+  uint8_t *entity_seen;             // Per DXCC entity, 1 once heard
+  struct budget budget;             // Shares of the config's memory budget
+  uint32_t heard_days;              // Days of call count sketches kept
+  struct shed shed;                 // Send backlog and what gave way to it
+  struct fresh fresh;               // Spot age at send and the archive of stale spots
+  struct psk psk;                   // Second sink with its own batching
+  struct cluster cluster;           // Telnet clients fed as spots go out
+
+  int32_t prevbfreq;                // Base frequency of the last status datagram
+  int32_t totalsize;                // Queued bytes
+  uint32_t last_day;                // Latest UTC day with a spot
+  uint32_t deadline;                // Spots of earlier slots missed their send, 0 without one
+  uint32_t lines, parsed, duplicates, firsts, band_slots, entities, late;
+  uint32_t uninterned;              // Spots skipped because the call table could not take their call
+};
+
+int uploader_open(struct uploader *u, const char *ip, uint16_t port, int blocking);
+void uploader_close(struct uploader *u);
+int uploader_line(struct uploader *u, char *line);
+int uploader_parse(struct uploader *u, char *line, struct spot *s);
+uint32_t uploader_slot(const struct uploader *u, double t);
+int uploader_filter(struct uploader *u, struct spot *s, time_t t, double sync, int32_t snr, double dt, int32_t freq);
+void uploader_accept(struct uploader *u, struct spot *s, time_t t);
+int uploader_decode(struct uploader *u, struct spot *s, time_t t, double sync, int32_t snr, double dt, int32_t freq,
+  const char *call, const char *grid);
+int uploader_add(struct uploader *u, const struct spot *s);
+int uploader_send(struct uploader *u);
+void uploader_rollover(struct uploader *u);
+void uploader_tick(struct uploader *u, uint32_t slot);
+void uploader_dump(struct uploader *u);
+void uploader_save(struct uploader *u);
+void uploader_summary(struct uploader *u);
+void uploader_budget_parse(struct uploader *u);
+void uploader_budget_encode(struct uploader *u);
+int uploader_reload(struct uploader *u);
+void uploader_swap_parse(struct uploader *u);
+void uploader_swap_encode(struct uploader *u);
+void uploader_swap(struct uploader *u);
+
+#endif
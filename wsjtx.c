@@ -0,0 +1,128 @@
+/* WSJT-X UDP protocol datagrams as understood by RBN Aggregator.
+   Uses a pruned version of the WSJT-X UDP broadcast
+   protocol because RBN Aggregator ignores many fields
+   in the datagrams.
+   */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "wsjtx.h"
+
+const char ID[] = "QMTECH FT8 RX 1.0";
+
+// Header including schema
+static const char header[8] = { 0xAD, 0xBC, 0xCB, 0xDA, 0x00, 0x00, 0x00, 0x02 };
+static const char msg1[4] = { 0x00, 0x00, 0x00, 0x01 };  // Message number for status datagram
+static const char msg2[4] = { 0x00, 0x00, 0x00, 0x02 }; // Message number for decode datagram
+
+static void copy_char(char **pointer, const char *value) {
+  int32_t size = strlen(value);
+  int32_t rsize = htonl(size);
+  memcpy(*pointer, &rsize, 4);
+  *pointer += 4;
+  memcpy(*pointer, value, size);
+  *pointer += size;
+}
+
+static void copy_int1(char **pointer, int8_t value) {
+  memcpy(*pointer, &value, 1);
+  *pointer += 1;
+}
+
+static void copy_int4(char **pointer, int32_t value) {
+  value = htonl(value);
+  memcpy(*pointer, &value, 4);
+  *pointer += 4;
+}
+
+static void copy_double(char **pointer, double value) {
+  double avalue;
+  uint64_t sign, exponent, mantissa, bits, rbits;
+
+  avalue = fabs(value);
+
+  if (avalue != 0.0) {
+    sign = (value < 0) ? 1 : 0;
+    exponent = (uint64_t)(log(avalue)/log(2.0) + 1023);
+    mantissa = (uint64_t)((avalue / pow(2, floor(log(avalue)/log(2.0))) - 1) * pow(2, 52));
+    bits = (sign & 0x1) << 63 | (exponent & 0x7ff) << 52 | mantissa & 0xfffffffffffff;
+    rbits = ((uint64_t)htonl(bits & 0xffffffff) << 32) | htonl(bits >> 32);
+//  printf("sign=%lu exponent=%lx mantissa=%lx bits=%016lx rbits=%016lx\n",
+//    sign, exponent, mantissa, bits, rbits);
+  }
+  else
+    rbits = 0;
+
+   memcpy(*pointer, &rbits, 8);
+  *pointer += 8;
+}
+
+// Status datagram announcing the base frequency, returns its size
+int32_t wsjtx_status(char *buffer, int32_t bfreq, const char *call, int32_t snr) {
+  char ssnr[8], *dst;
+
+  sprintf(ssnr, "%d", snr); // Report as string for status datagram
+
+  /*************************************************/
+  /* Prepare status datagram                       */
+  /*************************************************/
+
+  memcpy(buffer, header, sizeof(header)); // Start with header
+  dst = buffer + sizeof(header);
+  memcpy(dst, msg1, sizeof(msg1)); // Message identifier
+  dst += sizeof(msg1);
+  copy_char(&dst, ID);       // Receiver software ID - ignored by RBNA
+  copy_int4(&dst, 0);        // Base frequency as 8 byte integer
+  copy_int4(&dst, bfreq);
+  copy_char(&dst, "FT8");    // Rx Mode
+  copy_char(&dst, call);     // DX call - ignored by RBNA
+  copy_char(&dst, ssnr);     // SNR as string - ignored by RBNA
+  copy_char(&dst, "FT8");    // Tx Mode - ignored by RBNA
+  copy_int1(&dst, 0);        // TX enable = false - ignored by RBNA
+  copy_int1(&dst, 0);        // Transmitting = false - ignorded by RBNA
+  copy_int1(&dst, 0);        // Decoding = false - ignored by RBNA
+  copy_int4(&dst, 0);        // rxdf - ignored by RBNA
+  copy_int4(&dst, 0);        // txdf - ignored by  RBNA
+  copy_char(&dst, "AB1CDE"); // DE call - ignored by RBNA
+  copy_char(&dst, "AB12");   // DE grid - ignored by RBNA
+  copy_char(&dst, "AB12");   // DX grid - ignored by RBNA
+  copy_int1(&dst, 0);        // TX watchdog = false - ignored by RBNA
+  copy_char(&dst, "");       // Submode - ignored by RBNA
+  copy_int1(&dst, 0);        // Fast mode = false - ignored by RBNA
+  copy_int1(&dst, 0);        // Special operation mode = 0 - ignored by RBNA
+
+  return dst - buffer;
+}
+
+// Decode datagram carrying the spot as a fake CQ message, returns its size
+int32_t wsjtx_decode(char *buffer, int32_t snr, double dt, int32_t hz, const char *call, const char *grid) {
+  char message[32], *dst;
+
+  sprintf(message, "CQ %s %s", call, grid); // Compose fake message based on decode
+
+  /*************************************************/
+  /* Prepare decode datagram                       */
+  /*************************************************/
+
+  memcpy(buffer, header, sizeof(header)); // Header including schema information
+  dst = buffer + sizeof(header);
+  memcpy(dst, msg2, sizeof(msg2)); // Message identifier
+  dst += sizeof(msg2);
+  copy_char(&dst, ID);      // Software ID - ignored by RBNA
+  copy_int1(&dst, 1);       // New decode = true
+  copy_int4(&dst, 0);       // Time = zero - ignored by RBNA
+  copy_int4(&dst, snr);  	// Report as 4 byte integer
+//      printf("call=%s dt=%f ", call, dt);
+  copy_double(&dst, dt); 	// Delta time - ignored by RBNA
+  copy_int4(&dst, hz);      // Delta frequency in hertz - ignored by RBNA
+  copy_char(&dst, "FT8");   // Receive mode - ignored by RBNA
+  copy_char(&dst, message); // Fake message based on decode
+  copy_int1(&dst, 0);       // Low confidence = false - ignored by RBNA
+  copy_int1(&dst, 0);       // Off air = false - ignored by RBNA
+
+  return dst - buffer;
+}
@@ -0,0 +1,15 @@
+/* WSJT-X UDP protocol datagrams as understood by RBN Aggregator */
+
+#ifndef WSJTX_H
+#define WSJTX_H
+
+#include <stdint.h>
+
+#define WSJTX_MAX 256 // Largest datagram either function writes
+
+extern const char ID[];
+
+int32_t wsjtx_status(char *buffer, int32_t bfreq, const char *call, int32_t snr);
+int32_t wsjtx_decode(char *buffer, int32_t snr, double dt, int32_t hz, const char *call, const char *grid);
+
+#endif